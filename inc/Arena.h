@@ -0,0 +1,106 @@
+/**
+ * @file Arena.h
+ * @brief A monotonic memory resource for the scratch memory of decoding and encoding
+ *
+ * Containers built on std::pmr allocators take their memory from the arena by bumping a pointer, freeing is a no-op.
+ * Resetting the arena between streams makes all of its memory available again without returning it upstream, so once
+ * the arena has grown to the size of a stream, decoding further streams does not touch the heap at all.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace RD53
+{
+    /**
+     * @brief A monotonic memory resource which keeps its memory when reset
+     *
+     * The memory is taken from the upstream resource in blocks, which are only returned by release() or the
+     * destructor. The arena is not thread safe, use one per thread.
+     */
+    class Arena : public std::pmr::memory_resource
+    {
+    public:
+        /**
+         * @brief Constructs an Arena object
+         *
+         * @param block_size The size of the first block taken from the upstream resource, later blocks double in size
+         * @param upstream The resource the blocks are taken from
+         */
+        explicit Arena(size_t block_size = 64 * 1024, std::pmr::memory_resource *upstream = std::pmr::new_delete_resource());
+
+        ~Arena() override;
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        /**
+         * @brief Makes all memory available again, the blocks are kept
+         *
+         * Nothing allocated from the arena may be used afterwards, containers using it must be destroyed first.
+         */
+        void reset();
+
+        /**
+         * @brief Returns all blocks to the upstream resource
+         *
+         * Nothing allocated from the arena may be used afterwards, containers using it must be destroyed first.
+         */
+        void release();
+
+        /** @brief Returns the number of allocations served since construction */
+        size_t n_allocations() const { return n_allocations_; }
+
+        /** @brief Returns the number of bytes handed out since the last reset, including alignment padding */
+        size_t bytes_used() const;
+
+        /** @brief Returns the number of blocks taken from the upstream resource since construction */
+        size_t n_upstream_allocations() const { return n_upstream_allocations_; }
+
+        /** @brief Returns the total size of the blocks the arena holds */
+        size_t capacity() const;
+
+    private:
+        void *do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void *, size_t, size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+        /**
+         * @brief A block of memory taken from the upstream resource
+         */
+        struct Block
+        {
+            char *data;
+            size_t size;
+        };
+
+        /** @brief The resource the blocks are taken from */
+        std::pmr::memory_resource *upstream_;
+
+        /** @brief The size of the first block */
+        size_t block_size_;
+
+        /** @brief The blocks, in the order they are used */
+        std::vector<Block> blocks_;
+
+        /** @brief The index of the block allocations are served from */
+        size_t current_;
+
+        /** @brief The number of bytes used in the current block */
+        size_t used_;
+
+        /** @brief The number of allocations served since construction */
+        size_t n_allocations_;
+
+        /** @brief The number of blocks taken from the upstream resource since construction */
+        size_t n_upstream_allocations_;
+    };
+};
+
+#endif // ARENA_H
@@ -0,0 +1,248 @@
+/**
+ * @file BinaryTree.h
+ * @brief Encoding and decoding of the compressed (binary tree) hitmap of a quarter core
+ *
+ * The compressed hitmap splits the 16 pixels of a quarter core recursively in halves, quarters and pairs. Every
+ * node is encoded as a bit pair of which only the non-empty children are followed. A bit pair is written as '0' when
+ * only the second child has hits, '10' when only the first child has hits and '11' when both have hits, so a hitmap
+ * is between 4 and 30 bits long.
+ */
+
+#ifndef BINARYTREE_H
+#define BINARYTREE_H
+
+#include <array>
+#include <cstdint>
+
+#include "BitStream.h"
+
+namespace RD53
+{
+    namespace binary_tree
+    {
+        /** @brief The number of stream bits used as key of the decoding table */
+        constexpr uint8_t LUT_BITS = 14;
+
+        /** @brief The maximum length of a compressed hitmap */
+        constexpr uint8_t MAX_LENGTH = 30;
+
+        /**
+         * @brief An entry of the decoding table
+         */
+        struct LutEntry
+        {
+            /** @brief The decoded hitmap */
+            uint16_t hit_raw;
+            /** @brief The length of the code in bits, 0 if the code is longer than LUT_BITS */
+            uint8_t length;
+        };
+
+        /**
+         * @brief Decodes a compressed hitmap from a bit source
+         *
+         * The source needs a `peek2()` method returning the next two bits and a `skip(n)` method consuming bits.
+         *
+         * @param source The bit source positioned at the start of the hitmap
+         * @return The decoded 16-bit hitmap
+         */
+        template <typename Source>
+        constexpr uint16_t decode_hitmap(Source &source)
+        {
+            auto bitpair = [&source]() -> uint8_t
+            {
+                uint8_t bits = source.peek2() & 0b11;
+
+                if ((bits >> 1) == 0)
+                {
+                    source.skip(1);
+                    return 0b01;
+                }
+
+                source.skip(2);
+                return bits;
+            };
+
+            uint16_t hit_raw = 0;
+
+            uint8_t s1 = bitpair();
+
+            for (int i = 0; i < 2; ++i)
+            {
+                if ((s1 & (2 >> i)) == 0)
+                    continue;
+
+                uint8_t s2 = bitpair();
+
+                uint8_t ss3[2] = {0, 0};
+
+                for (int j = 0, total = (s2 >> 1) + (s2 & 1); j < total; j++)
+                    ss3[j] = bitpair();
+
+                uint8_t current_s3 = 0;
+
+                for (int j = 0; j < 2; j++)
+                {
+                    if ((s2 & (2 >> j)) == 0)
+                        continue;
+
+                    for (int k = 0; k < 2; k++)
+                    {
+                        if ((ss3[current_s3] & (2 >> k)) == 0)
+                            continue;
+
+                        uint8_t hitpair = bitpair();
+
+                        hit_raw |= (((hitpair & 0b01) << 1) | ((hitpair & 0b10) >> 1)) << (j * 4 + k * 2 + i * 8);
+                    }
+
+                    current_s3++;
+                }
+            }
+
+            return hit_raw;
+        }
+
+        /**
+         * @brief A binary tree code under construction
+         */
+        struct Code
+        {
+            /** @brief The code, right aligned */
+            uint32_t bits = 0;
+            /** @brief The length of the code in bits */
+            uint8_t length = 0;
+
+            /**
+             * @brief Appends the bit pair of a node with the given children, nothing if both are empty
+             */
+            constexpr void node(bool first, bool second)
+            {
+                if (first)
+                {
+                    bits = bits << 2 | 0b10 | second;
+                    length += 2;
+                }
+                else if (second)
+                {
+                    bits <<= 1;
+                    length += 1;
+                }
+            }
+
+            /**
+             * @brief Appends another code
+             */
+            constexpr void append(Code other)
+            {
+                bits = bits << other.length | other.bits;
+                length += other.length;
+            }
+        };
+
+        /**
+         * @brief Encodes one half (8 hits) of a hitmap, the part of the code below its root node
+         *
+         * @param hits The hits of the half, the first pair in the lowest bits
+         * @return The code of the half, at most 14 bits
+         */
+        constexpr Code encode_half(uint8_t hits)
+        {
+            Code code;
+
+            auto any = [hits](int first_bit, int n_bits) -> bool
+            { return (hits >> first_bit & ((1 << n_bits) - 1)) != 0; };
+
+            code.node(any(0, 4), any(4, 4));
+
+            for (int j = 0; j < 2; j++)
+            {
+                if (any(j * 4, 4))
+                    code.node(any(j * 4, 2), any(j * 4 + 2, 2));
+            }
+
+            for (int pair = 0; pair < 8; pair += 2)
+            {
+                if (any(pair, 2))
+                    code.node(hits >> pair & 1, hits >> (pair + 1) & 1);
+            }
+
+            return code;
+        }
+
+        /**
+         * @brief Encodes a hitmap as binary tree
+         *
+         * @param hit_raw The 16-bit hitmap
+         * @return The code and its length
+         */
+        constexpr Code encode_hitmap(uint16_t hit_raw)
+        {
+            uint8_t first = hit_raw & 0xFF, second = hit_raw >> 8;
+
+            Code code;
+
+            code.node(first != 0, second != 0);
+
+            if (first != 0)
+                code.append(encode_half(first));
+
+            if (second != 0)
+                code.append(encode_half(second));
+
+            return code;
+        }
+
+        /**
+         * @brief The encoding table, indexed by the hitmap
+         *
+         * An entry holds the code with a marker bit set just above it, `1 << length | code`, which keeps the table at
+         * 4 bytes per hitmap.
+         */
+        extern const std::array<uint32_t, 1 << 16> encode_table;
+
+        /**
+         * @brief Encodes a hitmap as binary tree through the encoding table
+         *
+         * @param hit_raw The 16-bit hitmap
+         * @return The code and its length
+         */
+        inline Code encode(uint16_t hit_raw)
+        {
+            uint32_t entry = encode_table[hit_raw];
+            uint8_t length = 31 - __builtin_clz(entry);
+
+            return {entry ^ (uint32_t(1) << length), length};
+        }
+
+        /** @brief The decoding table, indexed by the next LUT_BITS bits of the stream */
+        extern const std::array<LutEntry, 1 << LUT_BITS> decode_table;
+
+        /**
+         * @brief Decodes a compressed hitmap bit by bit, used for codes longer than LUT_BITS
+         *
+         * @param reader The reader positioned at the start of the hitmap
+         * @return The decoded 16-bit hitmap
+         */
+        uint16_t decode_slow(BitReader &reader);
+
+        /**
+         * @brief Decodes a compressed hitmap and consumes its bits from the reader
+         *
+         * @param reader The reader positioned at the start of the hitmap
+         * @return The decoded 16-bit hitmap
+         */
+        inline uint16_t decode(BitReader &reader)
+        {
+            const LutEntry &entry = decode_table[reader.peek(LUT_BITS)];
+
+            if (entry.length == 0)
+                return decode_slow(reader);
+
+            reader.skip(entry.length);
+
+            return entry.hit_raw;
+        }
+    };
+};
+
+#endif // BINARYTREE_H
@@ -0,0 +1,299 @@
+/**
+ * @file BitStream.h
+ * @brief Bit level access to RD53 data streams
+ *
+ * Every 64-bit word of a stream carries a few meta bits at the top (the end of stream bit and, optionally, the chip
+ * ID) followed by the payload. The payload of consecutive words forms one continuous bit stream, most significant bit
+ * first.
+ */
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace RD53
+{
+    /**
+     * @brief A type alias for a 64-bit unsigned integer
+     */
+    using word_t = unsigned long long;
+
+    /**
+     * @brief A read-only, non-owning view of a stream of words
+     *
+     * The view does not copy the words, the memory (a vector, DMA buffer, memory mapped file, ...) must outlive it.
+     */
+    struct StreamView
+    {
+        /** @brief Pointer to the first word */
+        const word_t *data = nullptr;
+        /** @brief The number of words */
+        size_t size = 0;
+
+        StreamView() = default;
+
+        StreamView(const word_t *data_, size_t size_) : data(data_), size(size_) {}
+
+        StreamView(const std::vector<word_t> &words) : data(words.data()), size(words.size()) {}
+
+        const word_t &operator[](size_t index) const { return data[index]; }
+
+        const word_t *begin() const { return data; }
+
+        const word_t *end() const { return data + size; }
+
+        bool empty() const { return size == 0; }
+    };
+
+    /**
+     * @brief Reads fields of arbitrary width from the payload of a stream of words
+     *
+     * The reader keeps between 0 and 127 payload bits in a 128-bit accumulator and loads the payload of one whole word
+     * whenever fewer bits are buffered than requested, so a read touches the words only once every few fields.
+     * Reading past the end of the stream yields zeros, which matches the padding of the last word of a stream.
+     */
+    class BitReader
+    {
+    public:
+        /**
+         * @brief Constructs a BitReader object
+         *
+         * @param words Pointer to the first word of the stream, the memory is not copied and must outlive the reader
+         * @param n_words The number of words in the stream
+         * @param meta_bits The number of meta bits at the top of every word
+         */
+        BitReader(const word_t *words = nullptr, size_t n_words = 0, uint8_t meta_bits = 1)
+            : words_(words), n_words_(n_words), payload_bits_(64 - meta_bits), payload_mask_(~word_t(0) >> meta_bits)
+        {
+            seek(0);
+        }
+
+        /**
+         * @brief Returns the next bits of the stream without consuming them
+         *
+         * @param n_bits The number of bits to return, at most 64
+         * @return The bits, right aligned
+         */
+        word_t peek(uint8_t n_bits)
+        {
+            if (n_bits == 0)
+                return 0;
+
+            while (n_bits > avail_)
+                _refill();
+
+            return static_cast<word_t>(acc_ >> 64) >> (64 - n_bits);
+        }
+
+        /**
+         * @brief Returns and consumes the next bits of the stream
+         *
+         * @param n_bits The number of bits to read, at most 64
+         * @return The bits, right aligned
+         */
+        word_t read(uint8_t n_bits)
+        {
+            word_t value = peek(n_bits);
+
+            _consume(n_bits);
+
+            return value;
+        }
+
+        /**
+         * @brief Consumes bits without returning them
+         *
+         * @param n_bits The number of bits to skip
+         */
+        void skip(size_t n_bits)
+        {
+            while (n_bits > avail_)
+            {
+                // drop everything buffered and continue in the next word
+                n_bits -= avail_;
+                acc_ = 0;
+                avail_ = 0;
+
+                if (n_bits < payload_bits_)
+                    _refill();
+                else
+                {
+                    next_word_++;
+                    n_bits -= payload_bits_;
+                }
+            }
+
+            _consume(n_bits);
+        }
+
+        /**
+         * @brief Moves the reader to an absolute bit position in the payload
+         *
+         * @param bit_index The bit index to continue reading from
+         */
+        void seek(size_t bit_index)
+        {
+            next_word_ = bit_index / payload_bits_;
+            acc_ = 0;
+            avail_ = 0;
+
+            skip(bit_index % payload_bits_);
+        }
+
+        /**
+         * @brief Returns the number of payload bits consumed so far
+         */
+        size_t position() const { return next_word_ * payload_bits_ - avail_; }
+
+        /**
+         * @brief Returns the number of payload bits of every word
+         */
+        uint8_t payload_bits() const { return payload_bits_; }
+
+        /**
+         * @brief Returns the total number of payload bits in the stream
+         */
+        size_t size() const { return n_words_ * payload_bits_; }
+
+        /**
+         * @brief Returns whether more bits were consumed than the stream contains
+         */
+        bool overrun() const { return position() > size(); }
+
+    private:
+        void _consume(uint8_t n_bits)
+        {
+            acc_ <<= n_bits;
+            avail_ -= n_bits;
+        }
+
+        /**
+         * @brief Appends the payload of the next word to the accumulator
+         */
+        void _refill()
+        {
+            // past the end the stream continues as zeros
+            word_t payload = next_word_ < n_words_ ? words_[next_word_] & payload_mask_ : 0;
+
+            acc_ |= static_cast<unsigned __int128>(payload) << (128 - payload_bits_ - avail_);
+            avail_ += payload_bits_;
+            next_word_++;
+        }
+
+        /** @brief The words of the stream */
+        const word_t *words_;
+
+        /** @brief The number of words in the stream */
+        size_t n_words_;
+
+        /** @brief The number of payload bits per word */
+        uint8_t payload_bits_;
+
+        /** @brief Mask selecting the payload bits of a word */
+        word_t payload_mask_;
+
+        /** @brief Index of the next word to load into the accumulator */
+        size_t next_word_;
+
+        /** @brief Buffered bits, most significant bit first */
+        unsigned __int128 acc_;
+
+        /** @brief The number of valid bits in the accumulator */
+        uint8_t avail_;
+    };
+
+    /**
+     * @brief Writes fields of arbitrary width into the payload of a stream of words
+     *
+     * Fields are packed most significant bit first into the payload bits of consecutive words, a word is appended as
+     * soon as its payload is complete. The meta bits are left zero, they are set once the stream is complete.
+     */
+    class BitWriter
+    {
+    public:
+        /**
+         * @brief Constructs a BitWriter object
+         *
+         * @param words The vector the words are appended to, must outlive the writer
+         * @param meta_bits The number of meta bits at the top of every word
+         */
+        BitWriter(std::vector<word_t> &words, uint8_t meta_bits = 1)
+            : words_(words), payload_bits_(64 - meta_bits), acc_(0), filled_(0), start_(words.size())
+        {
+        }
+
+        /**
+         * @brief Appends a field to the stream
+         *
+         * @param value The bits of the field, right aligned, bits above the width are ignored
+         * @param n_bits The width of the field, at most 64
+         */
+        void write(word_t value, uint8_t n_bits)
+        {
+            if (n_bits > 32)
+            {
+                // keeps the spill into the next word shorter than its payload
+                write(value >> 32, n_bits - 32);
+                n_bits = 32;
+            }
+
+            value &= (word_t(1) << n_bits) - 1;
+
+            uint8_t space = payload_bits_ - filled_;
+
+            if (n_bits < space)
+            {
+                acc_ = acc_ << n_bits | value;
+                filled_ += n_bits;
+                return;
+            }
+
+            uint8_t rest = n_bits - space;
+
+            words_.push_back(acc_ << space | value >> rest);
+
+            acc_ = value & ((word_t(1) << rest) - 1);
+            filled_ = rest;
+        }
+
+        /**
+         * @brief Pads the last word with zeros and appends it
+         */
+        void flush()
+        {
+            if (filled_ == 0)
+                return;
+
+            words_.push_back(acc_ << (payload_bits_ - filled_));
+
+            acc_ = 0;
+            filled_ = 0;
+        }
+
+        /**
+         * @brief Returns the number of payload bits written so far
+         */
+        size_t position() const { return (words_.size() - start_) * payload_bits_ + filled_; }
+
+    private:
+        /** @brief The vector the words are appended to */
+        std::vector<word_t> &words_;
+
+        /** @brief The number of payload bits per word */
+        uint8_t payload_bits_;
+
+        /** @brief The bits of the word being filled, right aligned */
+        word_t acc_;
+
+        /** @brief The number of bits in the word being filled */
+        uint8_t filled_;
+
+        /** @brief The number of words in the vector before the writer started */
+        size_t start_;
+    };
+};
+
+#endif // BITSTREAM_H
@@ -0,0 +1,140 @@
+/**
+ * @file CaptureFile.h
+ * @brief Zero-copy access to the streams of a raw capture file
+ *
+ * A capture file holds the raw 64-bit words of a link, written back to back in native byte order. The file is memory
+ * mapped instead of read, so the kernel pages it in on demand while the streams are decoded in place and the run never
+ * has to fit into memory. Streams are found through the end of stream bit 63 of their last word.
+ */
+
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BitStream.h"
+
+namespace RD53
+{
+    /**
+     * @brief A read-only memory mapped capture file, scanned stream by stream
+     *
+     * The views handed out point into the mapping and stay valid as long as the CaptureFile object (or the object it
+     * was moved to) exists. Words after the last end of stream, e.g. of a capture that was cut off, are not part of
+     * any stream.
+     */
+    class CaptureFile
+    {
+    public:
+        /**
+         * @brief Maps a capture file
+         *
+         * Throws std::runtime_error if the file cannot be opened or mapped, or if its size is not a whole number of
+         * words.
+         *
+         * @param path The path of the file
+         */
+        explicit CaptureFile(const std::string &path);
+
+        ~CaptureFile();
+
+        CaptureFile(const CaptureFile &) = delete;
+        CaptureFile &operator=(const CaptureFile &) = delete;
+
+        CaptureFile(CaptureFile &&other) noexcept;
+        CaptureFile &operator=(CaptureFile &&other) noexcept;
+
+        /**
+         * @brief Returns the next stream and moves past it
+         *
+         * @param stream Set to the words of the stream, including the word carrying the end of stream bit
+         * @return Whether a stream was found, false once all complete streams have been read
+         */
+        bool next(StreamView &stream);
+
+        /**
+         * @brief Moves back to the first stream
+         */
+        void rewind() { position_ = 0; }
+
+        /**
+         * @brief Moves to the stream starting at a word offset, e.g. one taken from a CaptureIndex
+         *
+         * Throws std::out_of_range if the offset is past the last complete stream.
+         *
+         * @param position The offset of the stream in words from the start of the file
+         */
+        void seek(size_t position);
+
+        /**
+         * @brief Returns the stream starting at a word offset, without moving
+         *
+         * Throws std::out_of_range if no complete stream starts at or after the offset.
+         *
+         * @param position The offset of the stream in words from the start of the file
+         */
+        StreamView stream_at(size_t position) const;
+
+        /**
+         * @brief Returns the offset of the next stream, in words from the start of the file
+         */
+        size_t position() const { return position_; }
+
+        /**
+         * @brief Scans the whole file
+         *
+         * @return Views of all complete streams, in file order
+         */
+        std::vector<StreamView> streams() const;
+
+        /**
+         * @brief Returns all words of the file
+         */
+        StreamView words() const { return StreamView(words_, n_words_); }
+
+        /** @brief Returns the number of words of the file */
+        size_t n_words() const { return n_words_; }
+
+        /** @brief Returns the number of words after the last end of stream */
+        size_t n_trailing_words() const { return n_words_ - n_complete_words_; }
+
+        /** @brief Returns the path of the file */
+        const std::string &path() const { return path_; }
+
+        /** @brief Returns the inode number of the file when it was mapped */
+        uint64_t inode() const { return inode_; }
+
+        /** @brief Returns the last modification time of the file when it was mapped, in ns since the epoch */
+        int64_t mtime_ns() const { return mtime_ns_; }
+
+    private:
+        /** @brief Unmaps the file */
+        void _unmap();
+
+        /** @brief The path of the file */
+        std::string path_;
+
+        /** @brief The start of the mapping, null for an empty file */
+        const word_t *words_;
+
+        /** @brief The number of words of the file */
+        size_t n_words_;
+
+        /** @brief The number of words up to and including the last end of stream */
+        size_t n_complete_words_;
+
+        /** @brief The offset of the next stream */
+        size_t position_;
+
+        /** @brief The inode number of the file */
+        uint64_t inode_;
+
+        /** @brief The last modification time of the file, in ns since the epoch */
+        int64_t mtime_ns_;
+    };
+};
+
+#endif // CAPTUREFILE_H
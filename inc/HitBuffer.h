@@ -0,0 +1,195 @@
+/**
+ * @file HitBuffer.h
+ * @brief A structure of arrays container for the pixel hits of one or more frames
+ *
+ * The columns, rows and ToTs of all hits are kept in three contiguous arrays, the hits of a frame (trigger) form a
+ * contiguous range given by the frame offsets. Cuts and histograms run as plain loops over the arrays, and the arrays
+ * are handed to numpy without conversion.
+ */
+
+#ifndef HITBUFFER_H
+#define HITBUFFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace RD53
+{
+    /**
+     * @brief A type alias for a tuple of two 16-bit unsigned integers and an 8-bit unsigned integer
+     *
+     * This type alias represents the coordinates of a hit in a QuarterCore. The first element of the tuple is the column
+     * index, the second element is the row index, and the third element is the total value of the hit.
+     */
+    using HitCoord = std::tuple<uint16_t, uint16_t, uint8_t>;
+
+    /**
+     * @brief The hits of a sequence of frames as separate column, row and ToT arrays
+     *
+     * Hits are always appended to the last frame. The offsets hold the index of the first hit of every frame followed
+     * by the total number of hits, so frame `i` spans `[offsets()[i], offsets()[i + 1])`.
+     */
+    class HitBuffer
+    {
+    public:
+        HitBuffer() : offsets_{0} {}
+
+        /**
+         * @brief Constructs a HitBuffer object with a single frame
+         *
+         * @param hits The hits of the frame
+         */
+        HitBuffer(const std::vector<HitCoord> &hits) : HitBuffer() { add_frame(hits); }
+
+        /**
+         * @brief Constructs a HitBuffer object with a frame per vector of hits
+         *
+         * @param frames The hits of every frame
+         */
+        HitBuffer(const std::vector<std::vector<HitCoord>> &frames) : HitBuffer()
+        {
+            size_t n_hits = 0;
+
+            for (const auto &frame : frames)
+                n_hits += frame.size();
+
+            reserve(n_hits);
+
+            for (const auto &frame : frames)
+                add_frame(frame);
+        }
+
+        /**
+         * @brief Starts a new, empty frame
+         */
+        void add_frame() { offsets_.push_back(size()); }
+
+        /**
+         * @brief Appends a frame
+         *
+         * @param hits The hits of the frame
+         */
+        void add_frame(const std::vector<HitCoord> &hits)
+        {
+            add_frame();
+
+            for (const auto &[col, row, tot] : hits)
+                push_back(col, row, tot);
+        }
+
+        /**
+         * @brief Appends a hit to the last frame
+         *
+         * @throws std::logic_error If the buffer has no frame yet
+         */
+        void push_back(uint16_t col, uint16_t row, uint8_t tot)
+        {
+            if (n_frames() == 0)
+                throw std::logic_error("HitBuffer has no frame to append the hit to");
+
+            col_.push_back(col);
+            row_.push_back(row);
+            tot_.push_back(tot);
+            offsets_.back()++;
+        }
+
+        /**
+         * @brief Reserves memory for a total number of hits
+         */
+        void reserve(size_t n_hits)
+        {
+            col_.reserve(n_hits);
+            row_.reserve(n_hits);
+            tot_.reserve(n_hits);
+        }
+
+        /**
+         * @brief Removes all hits and frames, the memory is kept
+         */
+        void clear()
+        {
+            col_.clear();
+            row_.clear();
+            tot_.clear();
+            offsets_.assign(1, 0);
+        }
+
+        /** @brief Returns the total number of hits */
+        size_t size() const { return col_.size(); }
+
+        /** @brief Returns whether the buffer holds no hits */
+        bool empty() const { return col_.empty(); }
+
+        /** @brief Returns the number of frames */
+        size_t n_frames() const { return offsets_.size() - 1; }
+
+        /** @brief Returns the number of hits in a frame */
+        size_t frame_size(size_t frame) const { return offsets_.at(frame + 1) - offsets_[frame]; }
+
+        /** @brief Returns the columns of all hits */
+        const std::vector<uint16_t> &cols() const { return col_; }
+
+        /** @brief Returns the rows of all hits */
+        const std::vector<uint16_t> &rows() const { return row_; }
+
+        /** @brief Returns the ToTs of all hits */
+        const std::vector<uint8_t> &tots() const { return tot_; }
+
+        /** @brief Returns the index of the first hit of every frame followed by the total number of hits */
+        const std::vector<size_t> &offsets() const { return offsets_; }
+
+        /**
+         * @brief Returns the hits of a frame as HitCoord tuples
+         *
+         * @throws std::out_of_range If the frame does not exist
+         */
+        std::vector<HitCoord> get_frame(size_t frame) const
+        {
+            if (frame >= n_frames())
+                throw std::out_of_range("frame " + std::to_string(frame) + " out of range, the buffer has " + std::to_string(n_frames()) + " frames");
+
+            std::vector<HitCoord> hits;
+            hits.reserve(frame_size(frame));
+
+            for (size_t i = offsets_[frame]; i < offsets_[frame + 1]; i++)
+                hits.emplace_back(col_[i], row_[i], tot_[i]);
+
+            return hits;
+        }
+
+        /**
+         * @brief Returns the hits of every frame as HitCoord tuples
+         */
+        std::vector<std::vector<HitCoord>> get_frames() const
+        {
+            std::vector<std::vector<HitCoord>> frames;
+            frames.reserve(n_frames());
+
+            for (size_t frame = 0; frame < n_frames(); frame++)
+                frames.push_back(get_frame(frame));
+
+            return frames;
+        }
+
+        bool operator==(const HitBuffer &other) const
+        {
+            return col_ == other.col_ && row_ == other.row_ && tot_ == other.tot_ && offsets_ == other.offsets_;
+        }
+
+    private:
+        /** @brief The column of every hit */
+        std::vector<uint16_t> col_;
+        /** @brief The row of every hit */
+        std::vector<uint16_t> row_;
+        /** @brief The ToT of every hit */
+        std::vector<uint8_t> tot_;
+        /** @brief The index of the first hit of every frame, followed by the number of hits */
+        std::vector<size_t> offsets_;
+    };
+};
+
+#endif // HITBUFFER_H
@@ -0,0 +1,150 @@
+/**
+ * @file QcoreLayout.h
+ * @brief The mapping between the hit indices of a quarter core and its pixels, as compile time tables
+ *
+ * A quarter core is either 4x4 (square) or 8x2 (wide) pixels. The hitmap of the stream orders its 16 bits by hit
+ * index, which depends on the geometry. Code working on pixels uses the column-major pixel position
+ * `col * height + row` instead, so the tables map between both orders and are indexed by `wide` first.
+ */
+
+#ifndef QCORELAYOUT_H
+#define QCORELAYOUT_H
+
+#include <array>
+#include <cstdint>
+
+namespace RD53
+{
+    namespace qcore_layout
+    {
+        /** @brief Returns the number of pixel columns of a quarter core */
+        constexpr uint8_t width(bool wide) { return wide ? 8 : 4; }
+
+        /** @brief Returns the number of pixel rows of a quarter core */
+        constexpr uint8_t height(bool wide) { return wide ? 2 : 4; }
+
+        /**
+         * @brief Returns the hit index of a pixel, without checking the coordinates
+         *
+         * The hits of a wide quarter core are mapped like:
+         *
+         *     0  1   2  3   4  5   6  7
+         *     8  9  10 11  12 13  14 15
+         *
+         * and those of a square one like:
+         *
+         *     0  2  4  6
+         *     1  3  5  7
+         *     8 10 12 14
+         *     9 11 13 15
+         */
+        constexpr uint8_t hit_index(bool wide, uint8_t col, uint8_t row)
+        {
+            if (wide)
+                return col + 8 * row;
+
+            return row > 1 ? 8 + col * 2 + row - 2 : col * 2 + row;
+        }
+
+        /**
+         * @brief A pixel of a quarter core
+         */
+        struct Pixel
+        {
+            uint8_t col;
+            uint8_t row;
+        };
+
+        constexpr std::array<Pixel, 16> make_pixel_table(bool wide)
+        {
+            std::array<Pixel, 16> table{};
+
+            for (uint8_t col = 0; col < width(wide); col++)
+            {
+                for (uint8_t row = 0; row < height(wide); row++)
+                    table[hit_index(wide, col, row)] = {col, row};
+            }
+
+            return table;
+        }
+
+        constexpr std::array<uint8_t, 16> make_index_table(bool wide)
+        {
+            std::array<uint8_t, 16> table{};
+
+            for (uint8_t col = 0; col < width(wide); col++)
+            {
+                for (uint8_t row = 0; row < height(wide); row++)
+                    table[col * height(wide) + row] = hit_index(wide, col, row);
+            }
+
+            return table;
+        }
+
+        /**
+         * @brief Builds the table remapping one byte of a bit mask, from hit index order to pixel order or back
+         *
+         * @param wide The geometry of the quarter core
+         * @param high Whether the table is for the high byte
+         * @param to_pixels Whether the table maps hit indices to pixel positions, else pixel positions to hit indices
+         */
+        constexpr std::array<uint16_t, 256> make_byte_table(bool wide, bool high, bool to_pixels)
+        {
+            std::array<Pixel, 16> pixels = make_pixel_table(wide);
+            std::array<uint8_t, 16> indices = make_index_table(wide);
+
+            std::array<uint16_t, 256> table{};
+
+            for (uint32_t bits = 0; bits < 256; bits++)
+            {
+                for (uint8_t bit = 0; bit < 8; bit++)
+                {
+                    if ((bits >> bit & 1) == 0)
+                        continue;
+
+                    uint8_t from = bit + (high ? 8 : 0);
+                    uint8_t to = to_pixels ? pixels[from].col * height(wide) + pixels[from].row : indices[from];
+
+                    table[bits] |= 1 << to;
+                }
+            }
+
+            return table;
+        }
+
+        /** @brief The pixel of every hit index */
+        inline constexpr std::array<std::array<Pixel, 16>, 2> PIXEL_OF = {make_pixel_table(false), make_pixel_table(true)};
+
+        /** @brief The hit index of every pixel position */
+        inline constexpr std::array<std::array<uint8_t, 16>, 2> INDEX_OF = {make_index_table(false), make_index_table(true)};
+
+        /** @brief The pixel mask of the low and the high byte of a hitmap */
+        inline constexpr std::array<std::array<uint16_t, 256>, 2> PIXELS_LOW = {make_byte_table(false, false, true), make_byte_table(true, false, true)};
+        inline constexpr std::array<std::array<uint16_t, 256>, 2> PIXELS_HIGH = {make_byte_table(false, true, true), make_byte_table(true, true, true)};
+
+        /** @brief The hitmap of the low and the high byte of a pixel mask */
+        inline constexpr std::array<std::array<uint16_t, 256>, 2> HITS_LOW = {make_byte_table(false, false, false), make_byte_table(true, false, false)};
+        inline constexpr std::array<std::array<uint16_t, 256>, 2> HITS_HIGH = {make_byte_table(false, true, false), make_byte_table(true, true, false)};
+
+        /**
+         * @brief Remaps a hitmap to a pixel mask, bit `col * height + row`
+         */
+        constexpr uint16_t to_pixels(bool wide, uint16_t hit_raw)
+        {
+            return PIXELS_LOW[wide][hit_raw & 0xFF] | PIXELS_HIGH[wide][hit_raw >> 8];
+        }
+
+        /**
+         * @brief Remaps a pixel mask, bit `col * height + row`, to a hitmap
+         */
+        constexpr uint16_t to_hits(bool wide, uint16_t pixels)
+        {
+            return HITS_LOW[wide][pixels & 0xFF] | HITS_HIGH[wide][pixels >> 8];
+        }
+
+        static_assert(to_hits(false, to_pixels(false, 0x1234)) == 0x1234 && to_hits(true, to_pixels(true, 0x8421)) == 0x8421, "the byte tables are inverse");
+        static_assert(to_pixels(false, 0b110) == 0b10010, "hit index 1 is pixel (0, 1), hit index 2 is pixel (1, 0)");
+    };
+};
+
+#endif // QCORELAYOUT_H
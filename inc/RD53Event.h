@@ -22,8 +22,15 @@
 #include <sstream>
 #include <cstdint>
 #include <fstream>
+#include <type_traits>
+#include <memory_resource>
 
 #include "utils.h"
+#include "BitStream.h"
+#include "HitBuffer.h"
+#include "Arena.h"
+#include "QcoreLayout.h"
+#include "CaptureFile.h"
 
 namespace RD53
 {
@@ -31,21 +38,82 @@ namespace RD53
     constexpr int N_QCORES_VERTICAL = 336 / 2;   // this is the physical number of rows quarter cores on the readout chip
     constexpr int N_QCORES_HORIZONTAL = 432 / 8; // this is the physical number of columns quarter cores on the readout chip
 
+    /** @brief A type alias for a pair of a 64-bit unsigned integer and an 8-bit unsigned integer */
+    using DataRead = std::pair<word_t, uint8_t>;
+
     /**
-     * @brief A type alias for a 64-bit unsigned integer
+     * @brief A pixel hit written by the decoder straight from the stream
      */
-    using word_t = unsigned long long;
+    struct PixelHit
+    {
+        /** @brief The column of the pixel on the chip */
+        uint16_t col;
+        /** @brief The row of the pixel on the chip */
+        uint16_t row;
+        /** @brief The ToT value of the hit, 0 when the stream drops the ToTs */
+        uint8_t tot;
+        /** @brief The index of the trigger in the stream the hit belongs to */
+        uint16_t event;
+
+        bool operator==(const PixelHit &other) const
+        {
+            return col == other.col && row == other.row && tot == other.tot && event == other.event;
+        }
+    };
 
-    /** @brief A type alias for a pair of a 64-bit unsigned integer and an 8-bit unsigned integer */
-    using DataRead = std::pair<word_t, uint8_t>;
+    /**
+     * @brief A cluster of 8-connected pixel hits found by the Clusterer
+     */
+    struct Cluster
+    {
+        /** @brief The first column of the bounding box */
+        uint16_t col_min;
+        /** @brief The last column of the bounding box */
+        uint16_t col_max;
+        /** @brief The first row of the bounding box */
+        uint16_t row_min;
+        /** @brief The last row of the bounding box */
+        uint16_t row_max;
+        /** @brief The number of hits in the cluster */
+        uint32_t size;
+        /** @brief The sum of the ToT values of the hits, 0 when the stream drops the ToTs */
+        uint32_t tot;
+        /** @brief The index of the trigger in the stream the cluster belongs to */
+        uint16_t event;
+
+        bool operator==(const Cluster &other) const
+        {
+            return col_min == other.col_min && col_max == other.col_max && row_min == other.row_min && row_max == other.row_max &&
+                   size == other.size && tot == other.tot && event == other.event;
+        }
+    };
 
     /**
-     * @brief A type alias for a tuple of two 16-bit unsigned integers and an 8-bit unsigned integer
-     *
-     * This type alias represents the coordinates of a hit in a QuarterCore. The first element of the tuple is the column
-     * index, the second element is the row index, and the third element is the total value of the hit.
+     * @brief The location and first trigger header of a stream in a capture file, as stored by the CaptureIndex
      */
-    using HitCoord = std::tuple<uint16_t, uint16_t, uint8_t>;
+    struct StreamIndexEntry
+    {
+        /** @brief The offset of the first word of the stream, in words from the start of the file */
+        uint64_t offset;
+        /** @brief The number of words of the stream */
+        uint32_t n_words;
+        /** @brief The BCID field of the first trigger, 0 unless the configuration has it */
+        uint16_t bcid;
+        /** @brief The L1ID field of the first trigger, 0 unless the configuration has it */
+        uint16_t l1id;
+        /** @brief The chip ID of the stream, 0 unless the configuration has it */
+        uint8_t chip_id;
+        /** @brief The trigger tag of the first trigger */
+        uint8_t trigger_tag;
+        /** @brief The trigger position of the first trigger */
+        uint8_t trigger_pos;
+
+        bool operator==(const StreamIndexEntry &other) const
+        {
+            return offset == other.offset && n_words == other.n_words && bcid == other.bcid && l1id == other.l1id &&
+                   chip_id == other.chip_id && trigger_tag == other.trigger_tag && trigger_pos == other.trigger_pos;
+        }
+    };
 
     /**
      * @brief A namespace containing constants representing the widths of different data fields in the RD53 event data stream
@@ -142,6 +210,10 @@ namespace RD53
      * The QuarterCore class represents a quarter core in a RD64 detector. It contains
      * information about the hits in the quarter core and provides methods to get and set
      * these hits.
+     *
+     * The object is a trivially copyable 16-byte record. Instead of pointing to the StreamConfig of its event it keeps
+     * the few bits of the configuration it needs (the geometry and the hitmap and ToT encoding), so vectors of quarter
+     * cores are copied with a plain memcpy and stay valid when the event is copied or moved.
      */
     class QuarterCore
     {
@@ -249,15 +321,37 @@ namespace RD53
          */
         std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> serialize_qcore(bool prev_last_in_col) const;
 
+        /**
+         * @brief Writes the quarter core data straight into a stream
+         *
+         * @param writer The writer of the stream
+         * @param prev_last_in_col A boolean indicating whether the previous element was the last in the column
+         */
+        void serialize_qcore(BitWriter &writer, bool prev_last_in_col) const;
+
         /**
          * @brief Returns the index in the hit map corresponding to the specified row and column
          *
          * @param row The row index
          * @param col The column index
          * @return The index in the hit map corresponding to the specified row and column
+         * @throws std::runtime_error If the quarter core has no config
+         * @throws std::invalid_argument If the coordinates are outside of the quarter core
          */
         uint8_t hit_index(uint8_t col, uint8_t row) const;
 
+        /**
+         * @brief Returns the index in the hit map of a pixel without checking the config or the coordinates
+         *
+         * For loops that already know the geometry, the coordinates must lie inside of the quarter core.
+         */
+        uint8_t hit_index_unchecked(uint8_t col, uint8_t row) const { return qcore_layout::INDEX_OF[wide_][col * _height() + row]; }
+
+        /**
+         * @brief Returns the hit and ToT at an index in the hit map without checking it, which must be below 16
+         */
+        std::pair<bool, uint8_t> get_hit_unchecked(uint8_t index) const { return {hits_ >> index & 0x1, tots_ >> (index * 4) & 0xF}; }
+
         /**
          * @brief Gets the column index of the quarter core
          *
@@ -341,18 +435,22 @@ namespace RD53
         void set_is_last_in_event(bool is_last_in_event) { is_last_in_event_ = is_last_in_event; }
 
         /**
-         * @brief Sets the StreamConfig object
+         * @brief Sets the geometry and encoding flags from a StreamConfig object
          *
-         * @param config The StreamConfig object
+         * @param config The StreamConfig object, nullptr removes the configuration
+         * @throws std::runtime_error If the qcore size is neither 4 x 4 nor 2 x 8
          */
-        void set_config(const StreamConfig *config) { this->config_ = config; }
+        void set_config(const StreamConfig *config);
 
         /**
          * @brief Gets the StreamConfig object
          *
+         * Only the fields a quarter core depends on are set: the qcore size, compressed_hitmap and drop_tot.
+         *
          * @return The StreamConfig object
+         * @throws std::runtime_error If the quarter core has no configuration
          */
-        StreamConfig get_config() const { return *config_; }
+        StreamConfig get_config() const;
 
         /**
          * @brief Returns a string representation of the QuarterCore object
@@ -364,352 +462,1182 @@ namespace RD53
         bool operator==(const QuarterCore &other) const;
 
     private:
+        /** @brief Throws if the quarter core has no configuration */
+        void _check_config() const;
+
+        /** @brief The number of pixel columns in the quarter core */
+        uint8_t _width() const { return qcore_layout::width(wide_); }
+
+        /** @brief The number of pixel rows in the quarter core */
+        uint8_t _height() const { return qcore_layout::height(wide_); }
+
         // Member variables
-        /** The StreamConfig object that contains the configuration parameters */
-        const StreamConfig *config_;
+        /** The total values of the hits in the quarter core */
+        uint64_t tots_;
+        /** The hit map representing the hits in the quarter core */
+        uint16_t hits_;
         /** The column index of the quarter core */
         uint8_t col_;
         /** The row index of the quarter core */
         uint8_t row_;
         /** A boolean indicating whether the quarter core is the last in the event */
-        bool is_last_;
+        uint8_t is_last_ : 1;
         /** A boolean indicating whether the quarter core is a neighbour */
-        bool is_neighbour_;
+        uint8_t is_neighbour_ : 1;
         /** A boolean indicating whether the quarter core is the last in the row */
-        bool is_last_in_event_;
-        /** The hit map representing the hits in the quarter core */
-        uint16_t hits_;
-        /** The total values of the hits in the quarter core */
-        uint64_t tots_;
+        uint8_t is_last_in_event_ : 1;
+        /** Whether the geometry and encoding flags below were set from a StreamConfig */
+        uint8_t has_config_ : 1;
+        /** The geometry, 2 x 8 pixels when set and 4 x 4 pixels otherwise */
+        uint8_t wide_ : 1;
+        /** Whether the hitmap is encoded as binary tree */
+        uint8_t compressed_hitmap_ : 1;
+        /** Whether the ToTs are left out of the stream */
+        uint8_t drop_tot_ : 1;
     };
 
+    static_assert(sizeof(QuarterCore) == 16 && std::is_trivially_copyable<QuarterCore>::value, "QuarterCore is meant to be a 16-byte record");
+
+    class Event;
+
     /**
-     * @brief Represents an Event object
+     * @brief The triggers of a stream in flat storage
      *
-     * The Event class represents an event in a RD53 detector. It contains
-     * information about the hits in the event and provides methods to get and set
-     * these hits.
+     * The quarter cores of all triggers are kept in one contiguous array and their headers in a parallel array,
+     * trigger `i` owns the quarter cores `[qcore_offsets()[i], qcore_offsets()[i + 1])`. The decoder fills a batch
+     * directly and consumers iterate it without recursing into sub-events or copying them.
+     *
+     * The batch has no hit array of its own. The hits are derived from the quarter cores by get_hits() when asked for,
+     * so the decoder writes every hit once and consumers of quarter cores (PixelHistogram, Clusterer, ChipBitmap) do
+     * not pay for hits they never read. Decoder::decode_hits(HitBuffer &) fills the flat hit array directly instead.
+     *
+     * The arrays take their memory from a std::pmr::memory_resource, typically an Arena which is reset between
+     * streams. A copy of a batch uses the default resource.
      */
-    class Event
+    class EventBatch
     {
     public:
-        Event() = default;
-        Event(const Event &other);
-        Event operator=(const Event &other);
-
         /**
-         * @brief Constructs an Event object
-         *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param hits The vector of hits in the event
-         * @param event_tag The event tag (default: 0)
-         * @param chip_id The chip ID (default: 0)
-         * @param lcid The local chamber ID (default: 0)
-         * @param bcid The board chamber ID (default: 0)
+         * @brief A read-only view of the quarter cores of one trigger
          */
-        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<HitCoord> &hits);
+        struct QcoreView
+        {
+            /** @brief Pointer to the first quarter core */
+            const QuarterCore *data = nullptr;
+            /** @brief The number of quarter cores */
+            size_t size = 0;
 
-        /**
-         * @brief Constructs an Event object
-         *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param header The StreamHeader object that contains the header of the event
-         * @param qcores The vector of QuarterCore objects that contain the hits in the event
-         */
-        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<QuarterCore> &qcores);
+            const QuarterCore &operator[](size_t index) const { return data[index]; }
+
+            const QuarterCore *begin() const { return data; }
+
+            const QuarterCore *end() const { return data + size; }
+
+            bool empty() const { return size == 0; }
+        };
 
         /**
-         * @brief Constructs an Event object with hits
-         *
-         * This constructor initializes an Event object using a given configuration,
-         * header, and a nested vector of hits.
+         * @brief Constructs an empty EventBatch object
          *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param header The StreamHeader object that contains the header of the event
-         * @param hits A nested vector of HitCoord objects representing the hits in the event
+         * @param config The StreamConfig object that contains the configuration parameters of all triggers
+         * @param resource The memory resource of the arrays, must outlive the batch
          */
-        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<HitCoord>> &frames);
+        EventBatch(const StreamConfig &config = StreamConfig(), std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
         /**
-         * @brief Constructs an Event object with QuarterCores
-         *
-         * This constructor initializes an Event object using a given configuration,
-         * header, and a nested vector of QuarterCore objects.
+         * @brief Starts a new trigger without quarter cores
          *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param header The StreamHeader object that contains the header of the event
-         * @param qcores A nested vector of QuarterCore objects containing the hits in the event
+         * @param header The header of the trigger
          */
-        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<QuarterCore>> &frames);
+        void add_trigger(const StreamHeader &header = StreamHeader())
+        {
+            headers_.push_back(header);
+            offsets_.push_back(qcores_.size());
+        }
 
         /**
-         * @brief Serializes the event data into a vector of 64-bit integers
+         * @brief Appends a quarter core to the last trigger
          *
-         * @return A vector of 64-bit integers containing the serialized event data
+         * @throws std::logic_error If the batch has no trigger yet
          */
-        std::vector<word_t> serialize_event();
+        void push_qcore(const QuarterCore &qcore)
+        {
+            if (headers_.empty())
+                throw std::logic_error("EventBatch has no trigger to append the quarter core to");
+
+            qcores_.push_back(qcore);
+            offsets_.back()++;
+        }
 
         /**
-         * Retrieves the vector of QuarterCore objects representing the quarter cores in the event.
-         *
-         * @return The vector of QuarterCore objects.
-         *
-         * @throws None
+         * @brief Removes all triggers, the memory is kept
          */
-        std::vector<std::vector<QuarterCore>> get_qcores()
+        void clear()
         {
-            if (hits.empty() && qcores.empty())
-                return std::vector<std::vector<QuarterCore>>();
-            else if (qcores.empty())
-                _get_qcores_from_pixelframe();
+            headers_.clear();
+            qcores_.clear();
+            offsets_.assign(1, 0);
+        }
 
-            std::vector<std::vector<QuarterCore>> output;
+        /** @brief Returns the configuration of all triggers */
+        const StreamConfig &get_config() const { return config_; }
 
-            output.push_back(qcores);
+        /** @brief Returns the number of triggers */
+        size_t n_triggers() const { return headers_.size(); }
 
-            for (auto &event : events)
-            {
-                output.push_back(event.get_qcores()[0]);
-            }
+        /** @brief Returns the header of every trigger */
+        const std::pmr::vector<StreamHeader> &headers() const { return headers_; }
 
-            for (auto &qcores : output)
-            {
-                for (auto &qcore : qcores)
-                {
-                    qcore.set_config(nullptr);
-                }
-            }
+        /** @brief Returns the quarter cores of all triggers */
+        const std::pmr::vector<QuarterCore> &qcores() const { return qcores_; }
 
-            return output;
-        }
+        /** @brief Returns the index of the first quarter core of every trigger followed by the number of quarter cores */
+        const std::pmr::vector<size_t> &qcore_offsets() const { return offsets_; }
 
         /**
-         * Retrieves the vector of hits in the event.
-         *
-         * @return The vector of hits in the event.
+         * @brief Returns a view of the quarter cores of a trigger
          *
-         * @throws None
+         * @throws std::out_of_range If the trigger does not exist
          */
-        std::vector<std::vector<HitCoord>> get_hits()
+        QcoreView get_qcores(size_t trigger) const
         {
-            if (hits.empty() && qcores.empty())
-                return std::vector<std::vector<HitCoord>>();
-            else if (hits.empty())
-                _get_pixelframe_from_qcores();
-
-            std::vector<std::vector<HitCoord>> output;
-
-            output.push_back(hits);
-
-            for (auto &event : events)
-            {
-                output.push_back(event.get_hits()[0]);
-            }
+            if (trigger >= n_triggers())
+                throw std::out_of_range("trigger " + std::to_string(trigger) + " out of range, the batch has " + std::to_string(n_triggers()) + " triggers");
 
-            return output;
+            return {qcores_.data() + offsets_[trigger], offsets_[trigger + 1] - offsets_[trigger]};
         }
 
         /**
-         * @brief Create a string from the data of this class
+         * @brief Returns the hits of all triggers, one frame per trigger
          *
-         * @return A string containing the data of this class
+         * The hits of a trigger are in the order of its quarter cores, within a quarter core by hit index. They are
+         * rebuilt from the quarter cores on every call.
          */
-        std::string as_str() const;
-
-        void set_debug(bool debug) { this->debug = debug; }
+        HitBuffer get_hits() const;
 
-        /** The StreamConfig object that contains the configuration parameters */
-        StreamConfig config;
+        /**
+         * @brief Returns a single trigger as an Event object without sub-events
+         *
+         * @throws std::out_of_range If the trigger does not exist
+         */
+        Event get_event(size_t trigger) const;
 
-        /** The event header */
-        StreamHeader header;
     private:
-        Event(const StreamConfig &config, const std::vector<std::pair<StreamHeader, std::vector<QuarterCore>>>);
+        /** @brief The StreamConfig object that contains the configuration parameters */
+        StreamConfig config_;
 
-        /**
-         * @brief debug
-         */
-        bool debug = false;
+        /** @brief The header of every trigger */
+        std::pmr::vector<StreamHeader> headers_;
 
-        /** The vector of hits in the event */
-        std::vector<HitCoord> hits;
+        /** @brief The quarter cores of all triggers */
+        std::pmr::vector<QuarterCore> qcores_;
 
-        /** The vector of QuarterCore objects representing the quarter cores in the event */
-        std::vector<QuarterCore> qcores;
+        /** @brief The index of the first quarter core of every trigger, followed by the number of quarter cores */
+        std::pmr::vector<size_t> offsets_;
 
-        /** The vector of sub-events in the event */
-        std::vector<Event> events;
+        friend class Decoder;
+    };
 
+    /**
+     * @brief Groups the hits of decoded quarter cores into clusters of 8-connected pixels
+     *
+     * The hitmap of every quarter core is remapped to a column-major pixel mask, in which the components inside the
+     * quarter core are grown by shift and OR operations. Components touching across a quarter core boundary are
+     * joined through a union-find over the neighbouring quarter cores. The buffers are kept between calls, so a
+     * clusterer is reused for many triggers; it is not thread safe, use one per thread.
+     */
+    class Clusterer
+    {
+    public:
         /**
-         * @brief Retrieves the quarter core data in the event
+         * @brief Constructs a Clusterer object
          *
-         * @return A vector of tuples containing the serialized quarter core data
+         * @param config The StreamConfig object that contains the quarter core size of the clustered quarter cores
+         * @throws std::runtime_error If the quarter core size is not supported
          */
-        std::vector<std::tuple<uint8_t, word_t, DataTags>> _retrieve_qcore_data();
+        Clusterer(const StreamConfig &config = StreamConfig());
 
         /**
-         * @brief Retrieves the quarter cores in the event
+         * @brief Clusters the quarter cores of one trigger
+         *
+         * Clusters are appended in the order of the quarter core holding their first hit.
          *
-         * This function retrieves the quarter cores in the event by calling the
-         * _get_qcores_from_pixelframe() method of each QuarterCore object in the qcores vector.
+         * @param qcores The quarter cores of the trigger
+         * @param clusters The buffer the clusters are appended to
+         * @param event The trigger index stored in the clusters
+         * @return The number of clusters appended
+         * @throws std::out_of_range If a quarter core lies outside of the chip
+         * @throws std::invalid_argument If a quarter core appears twice
          */
-        void _get_qcores_from_pixelframe();
+        size_t cluster(EventBatch::QcoreView qcores, std::vector<Cluster> &clusters, uint16_t event = 0);
 
         /**
-         * @brief Retrieves the pixel frame in the event
+         * @brief Clusters every trigger of a batch, the trigger index is stored in the clusters
          *
-         * This function retrieves the pixel frame in the event by calling the
-         * _get_pixelframe_from_qcores() method of each QuarterCore object in the qcores vector.
+         * @param batch The decoded triggers
+         * @param clusters The buffer the clusters are appended to
+         * @return The number of clusters appended
+         * @throws std::invalid_argument If the batch has another quarter core size
          */
-        void _get_pixelframe_from_qcores();
-    
-        friend class Decoder;
-    };
-
-    /**
-     * @brief Represents a TEPXEvent object.
-     *
-     * The TEPXEvent class encapsulates the details of a TEPX event, which includes vectors of hits,
-     * quarter cores, and sub-events. It provides methods to retrieve and manipulate this event data.
-     */
-    class TEPXEvent
-    {
-    public:
-        TEPXEvent() = default;
+        size_t cluster(const EventBatch &batch, std::vector<Cluster> &clusters);
 
+    private:
         /**
-         * @brief Constructs an Event object
-         *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param header The StreamHeader object that contains the header of the event
-         * @param hits The vector of hits in the event
+         * @brief The hits of a quarter core that are connected inside of it
          */
-        TEPXEvent(const StreamConfig &config, const StreamHeader &header, const std::vector<HitCoord> &hits);
+        struct Component
+        {
+            /** @brief The cell of the quarter core on the chip, qcol * N_QCORES_VERTICAL + qrow */
+            uint32_t cell;
+            /** @brief The pixels of the component, bit x * height + y */
+            uint16_t pixels;
+            /** @brief The union-find parent */
+            uint32_t parent;
+            /** @brief The cluster of the root, valid once assigned */
+            uint32_t cluster;
+            /** @brief The properties of the component, merged into the cluster of its root */
+            Cluster summary;
+        };
 
         /**
-         * @brief Constructs an Event object with hits
-         *
-         * This constructor initializes an Event object using a given configuration,
-         * header, and a nested vector of hits.
-         *
-         * @param config The StreamConfig object that contains the configuration parameters
-         * @param header The StreamHeader object that contains the header of the event
-         * @param hits A nested vector of HitCoord objects representing the hits in the event
+         * @brief The components of a quarter core, which are stored next to each other
          */
-        TEPXEvent(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<HitCoord>> &frames_);
+        struct Cell
+        {
+            uint32_t first;
+            uint32_t count;
+        };
 
-        /** The StreamConfig object that contains the configuration parameters */
-        const StreamConfig config;
+        /**
+         * @brief Returns the pixels of a component grown by one pixel in all 8 directions inside the quarter core
+         */
+        uint16_t _dilate(uint16_t pixels) const;
 
-        /** The event header */
-        const StreamHeader header;
+        /**
+         * @brief Splits a quarter core into its components
+         */
+        void _add_components(const QuarterCore &qcore, uint16_t event);
 
         /**
-         * @brief serialize the event
-         * 
-         * @return std::array<std::vector<word_t>, 4> 
+         * @brief Joins the components of all quarter cores touching the given one at a higher column or row
          */
-        std::array<std::vector<word_t>, 4> serialize_event();
+        void _join_neighbours(uint32_t component);
 
         /**
-         * @brief Get the chip
-         * 
-         * @param chip_id 
-         * @return const Event 
+         * @brief Returns the root of a component, halving the path on the way
          */
-        const Event get_chip(uint8_t chip_id) const { return chips[chip_id]; }
+        uint32_t _find(uint32_t component);
 
-    private:
-        std::vector<std::vector<HitCoord>> frames;
+        /** @brief The StreamConfig object that contains the quarter core size */
+        StreamConfig config_;
 
-        std::array<Event, 4> chips;
-    };
+        /** @brief Whether the quarter cores are 8x2 instead of 4x4 pixels */
+        bool wide_;
+
+        /** @brief The width and height of a quarter core */
+        uint8_t width_, height_;
+
+        /** @brief The pixels of the first column, the first row and the last row of a quarter core */
+        uint16_t first_col_, first_row_, last_row_;
+
+        /** @brief The components of every quarter core of the chip, empty outside of a call */
+        std::vector<Cell> cells_;
 
+        /** @brief The cells holding components in the current call */
+        std::vector<uint32_t> touched_;
+
+        /** @brief The components of the current trigger */
+        std::vector<Component> components_;
+    };
 
     /**
-     * @brief A class for decoding streams of RD53 event data
+     * @brief A bit per pixel of the chip, telling whether it was hit
+     *
+     * Pixel `(col, row)` is bit `col * height() + row`, the pixel order of Decoder::decode_occupancy. Both quarter core
+     * sizes give the same number of pixels, which fill the words exactly, so whole-chip operations are plain loops over
+     * the words. The quarter cores of a column of quarter cores are a contiguous, word aligned range of bits, and the
+     * pixels a quarter core has in a pixel column never straddle a word.
      */
-    class Decoder
+    class ChipBitmap
     {
     public:
+        /** @brief The number of pixels of the chip */
+        static constexpr size_t N_PIXELS = 432 * 336;
+
+        /** @brief The number of 64-bit words of the bitmap */
+        static constexpr size_t N_WORDS = N_PIXELS / 64;
+
         /**
-         * @brief Constructs a new Decoder object
+         * @brief Constructs an empty ChipBitmap object
          *
-         * @param config The StreamConfig object containing the configuration parameters
-         * @param words The vector of 64-bit unsigned integers containing the event data stream
+         * @param config The StreamConfig object that contains the quarter core size
+         * @throws std::runtime_error If the quarter core size is not supported
          */
-        Decoder(const StreamConfig &config, std::vector<word_t> &words);
+        ChipBitmap(const StreamConfig &config = StreamConfig());
 
         /**
-         * @brief Decodes the event data stream
+         * @brief Constructs a ChipBitmap object with the hits of a trigger
+         *
+         * @param config The StreamConfig object that contains the quarter core size
+         * @param qcores The quarter cores of the trigger
          */
-        void process_stream();
-
-        Event get_event() const;
-
-        void set_debug(bool debug) { this->debug = debug; }
+        ChipBitmap(const StreamConfig &config, EventBatch::QcoreView qcores);
 
-    private:
         /**
-         * @brief Validates the chip ID field
+         * @brief Sets the pixels hit in a quarter core
+         *
+         * @throws std::out_of_range If the quarter core lies outside of the chip
          */
-        void _validate_chip_id();
+        void add(const QuarterCore &qcore);
 
         /**
-         * @brief Gets the trigger IDs from the event data stream
+         * @brief Sets the pixels hit in all quarter cores of a trigger
+         *
+         * @throws std::out_of_range If a quarter core lies outside of the chip
          */
-        void _get_trigger_ids();
+        void add(EventBatch::QcoreView qcores);
 
         /**
-         * @brief Gets the trigger tag from the event data stream
+         * @brief Sets a single pixel
+         *
+         * @throws std::out_of_range If the pixel lies outside of the chip
+         */
+        void set(uint16_t col, uint16_t row);
+
+        /**
+         * @brief Returns whether a pixel is set
+         *
+         * @throws std::out_of_range If the pixel lies outside of the chip
+         */
+        bool test(uint16_t col, uint16_t row) const;
+
+        /**
+         * @brief Returns the quarter cores of the set pixels in encoding order, ready to build an Event from
+         *
+         * The bitmap holds no ToTs, so all ToT values are 0.
+         */
+        std::vector<QuarterCore> to_qcores() const;
+
+        /** @brief Returns the number of set pixels */
+        size_t count() const;
+
+        /** @brief Returns whether no pixel is set */
+        bool none() const;
+
+        /** @brief Clears all pixels */
+        void clear();
+
+        /** @brief Returns the number of pixel columns of the chip */
+        size_t width() const { return width_; }
+
+        /** @brief Returns the number of pixel rows of the chip */
+        size_t height() const { return height_; }
+
+        /** @brief Returns the words of the bitmap */
+        const std::vector<uint64_t> &words() const { return words_; }
+
+        /** @brief Returns the StreamConfig object the bitmap was built for */
+        const StreamConfig &get_config() const { return config_; }
+
+        /**
+         * @brief Combines the pixels with those of another bitmap
+         *
+         * @throws std::invalid_argument If the other bitmap has another quarter core size
+         */
+        ChipBitmap &operator&=(const ChipBitmap &other);
+        ChipBitmap &operator|=(const ChipBitmap &other);
+        ChipBitmap &operator^=(const ChipBitmap &other);
+
+        ChipBitmap operator&(const ChipBitmap &other) const { return ChipBitmap(*this) &= other; }
+        ChipBitmap operator|(const ChipBitmap &other) const { return ChipBitmap(*this) |= other; }
+        ChipBitmap operator^(const ChipBitmap &other) const { return ChipBitmap(*this) ^= other; }
+
+        /** @brief Returns the bitmap with every pixel flipped, for masking with & */
+        ChipBitmap operator~() const;
+
+        bool operator==(const ChipBitmap &other) const { return width_ == other.width_ && words_ == other.words_; }
+
+    private:
+        /**
+         * @brief Checks that another bitmap has the same quarter core size
+         *
+         * @throws std::invalid_argument If it has another quarter core size
+         */
+        void _check_size(const ChipBitmap &other) const;
+
+        /**
+         * @brief Returns up to 64 bits starting at any bit, the first one in the lowest bit
+         */
+        uint64_t _read(size_t bit, uint8_t n_bits) const;
+
+        /** @brief The StreamConfig object that contains the quarter core size */
+        StreamConfig config_;
+
+        /** @brief Whether the quarter cores are 8x2 instead of 4x4 pixels */
+        bool wide_;
+
+        /** @brief The width and height of a quarter core */
+        uint8_t qcore_width_, qcore_height_;
+
+        /** @brief The number of pixel columns and rows of the chip */
+        size_t width_, height_;
+
+        /** @brief The bits of all pixels */
+        std::vector<uint64_t> words_;
+    };
+
+    /**
+     * @brief Per-pixel hit counts and ToT histograms of a chip, accumulated over many triggers
+     *
+     * The counters are filled straight from the hitmaps and packed ToTs of decoded quarter cores. Pixel `(col, row)`
+     * has its hit count at `col * height() + row` and its ToT histogram at `(col * height() + row) * N_TOT_BINS`,
+     * the same pixel order as Decoder::decode_occupancy. Instances are not thread safe, scans running on several
+     * threads fill one histogram per thread and merge them afterwards.
+     */
+    class PixelHistogram
+    {
+    public:
+        /** @brief The number of ToT bins per pixel */
+        static constexpr size_t N_TOT_BINS = 16;
+
+        /**
+         * @brief Constructs an empty PixelHistogram object
+         *
+         * @param config The StreamConfig object that contains the quarter core size of the filled quarter cores
+         * @throws std::runtime_error If the quarter core size is not supported
+         */
+        PixelHistogram(const StreamConfig &config = StreamConfig());
+
+        /**
+         * @brief Adds the hits of a quarter core
+         *
+         * @throws std::out_of_range If the quarter core lies outside of the chip
+         */
+        void fill(const QuarterCore &qcore);
+
+        /**
+         * @brief Adds the hits of all triggers of a batch
+         *
+         * @throws std::invalid_argument If the batch has another quarter core size
+         */
+        void fill(const EventBatch &batch);
+
+        /**
+         * @brief Adds the counters of another histogram, typically one filled on another thread
+         *
+         * @throws std::invalid_argument If the other histogram has another quarter core size
+         */
+        void merge(const PixelHistogram &other);
+
+        /**
+         * @brief Sets all counters to zero
+         */
+        void clear();
+
+        /** @brief Returns the number of pixel columns of the chip */
+        size_t width() const { return width_; }
+
+        /** @brief Returns the number of pixel rows of the chip */
+        size_t height() const { return height_; }
+
+        /** @brief Returns the total number of hits filled */
+        uint64_t n_hits() const { return n_hits_; }
+
+        /** @brief Returns the hit count of every pixel, indexed by col * height() + row */
+        const std::vector<uint32_t> &hit_counts() const { return hits_; }
+
+        /** @brief Returns the ToT histogram of every pixel, indexed by (col * height() + row) * N_TOT_BINS + tot */
+        const std::vector<uint32_t> &tot_counts() const { return tots_; }
+
+        /** @brief Returns the StreamConfig object the histogram was built for */
+        const StreamConfig &get_config() const { return config_; }
+
+    private:
+        /** @brief The StreamConfig object that contains the quarter core size */
+        StreamConfig config_;
+
+        /** @brief The number of pixel columns and rows of the chip */
+        size_t width_, height_;
+
+        /** @brief The offset of every hit index of a quarter core from the pixel of its first column and row */
+        std::array<uint32_t, 16> pixel_offsets_;
+
+        /** @brief The total number of hits filled */
+        uint64_t n_hits_;
+
+        /** @brief The hit count of every pixel */
+        std::vector<uint32_t> hits_;
+
+        /** @brief The ToT histogram of every pixel */
+        std::vector<uint32_t> tots_;
+    };
+
+    /**
+     * @brief Represents an Event object
+     *
+     * The Event class represents an event in a RD53 detector. It contains
+     * information about the hits in the event and provides methods to get and set
+     * these hits.
+     */
+    class Event
+    {
+    public:
+        Event() = default;
+
+        /**
+         * @brief Constructs an Event object
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param hits The vector of hits in the event
+         * @param event_tag The event tag (default: 0)
+         * @param chip_id The chip ID (default: 0)
+         * @param lcid The local chamber ID (default: 0)
+         * @param bcid The board chamber ID (default: 0)
+         */
+        Event(const StreamConfig &config, const StreamHeader &header, std::vector<HitCoord> hits);
+
+        /**
+         * @brief Constructs an Event object
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param qcores The vector of QuarterCore objects that contain the hits in the event
+         */
+        Event(const StreamConfig &config, const StreamHeader &header, std::vector<QuarterCore> qcores);
+
+        /**
+         * @brief Constructs an Event object with hits
+         *
+         * This constructor initializes an Event object using a given configuration,
+         * header, and a nested vector of hits.
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param hits A nested vector of HitCoord objects representing the hits in the event
+         */
+        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<HitCoord>> &frames);
+
+        /**
+         * @brief Constructs an Event object with QuarterCores
+         *
+         * This constructor initializes an Event object using a given configuration,
+         * header, and a nested vector of QuarterCore objects.
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param qcores A nested vector of QuarterCore objects containing the hits in the event
+         */
+        Event(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<QuarterCore>> &frames);
+
+        /**
+         * @brief Constructs an Event object from the frames of a HitBuffer
+         *
+         * The first frame holds the hits of the event, every further frame becomes a sub-event like in the
+         * constructor taking a nested vector of hits.
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param hits The hits of every frame
+         */
+        Event(const StreamConfig &config, const StreamHeader &header, const HitBuffer &hits);
+
+        /**
+         * @brief Constructs an Event object from the triggers of an EventBatch
+         *
+         * The first trigger is the event, every further trigger becomes a sub-event.
+         *
+         * @param batch The batch, which needs at least one trigger
+         * @throws std::invalid_argument If the batch has no triggers
+         */
+        Event(const EventBatch &batch);
+
+        Event(const Event &) = default;
+        Event &operator=(const Event &) = default;
+
+        /** @brief Takes over the hits, quarter cores and sub-events of another event without copying them */
+        Event(Event &&) noexcept = default;
+        Event &operator=(Event &&) noexcept = default;
+
+        /**
+         * @brief Serializes the event data into a vector of 64-bit integers
+         *
+         * @return A vector of 64-bit integers containing the serialized event data
+         */
+        std::vector<word_t> serialize_event();
+
+        /**
+         * Retrieves the vector of QuarterCore objects representing the quarter cores in the event.
+         *
+         * @return The vector of QuarterCore objects.
+         *
+         * @throws None
+         */
+        std::vector<std::vector<QuarterCore>> get_qcores()
+        {
+            if (hits.empty() && qcores.empty())
+                return std::vector<std::vector<QuarterCore>>();
+
+            std::vector<std::vector<QuarterCore>> output;
+            output.reserve(events.size() + 1);
+
+            output.push_back(qcores_view());
+
+            for (auto &event : events)
+            {
+                output.push_back(event.qcores_view());
+            }
+
+            return output;
+        }
+
+        /**
+         * Retrieves the vector of hits in the event.
+         *
+         * @return The vector of hits in the event.
+         *
+         * @throws None
+         */
+        std::vector<std::vector<HitCoord>> get_hits()
+        {
+            if (hits.empty() && qcores.empty())
+                return std::vector<std::vector<HitCoord>>();
+
+            std::vector<std::vector<HitCoord>> output;
+            output.reserve(events.size() + 1);
+
+            output.push_back(hits_view());
+
+            for (auto &event : events)
+            {
+                output.push_back(event.hits_view());
+            }
+
+            return output;
+        }
+
+        /**
+         * @brief Returns the stored quarter cores of this trigger without its sub-events and without copying them
+         *
+         * The quarter cores are built from the hits on first use. The reference stays valid until the event is
+         * modified, moved or destroyed.
+         */
+        const std::vector<QuarterCore> &qcores_view()
+        {
+            if (qcores.empty() && !hits.empty())
+                _get_qcores_from_pixelframe();
+
+            return qcores;
+        }
+
+        /**
+         * @brief Returns the stored hits of this trigger without its sub-events and without copying them
+         *
+         * The hits are built from the quarter cores on first use. The reference stays valid until the event is
+         * modified, moved or destroyed.
+         */
+        const std::vector<HitCoord> &hits_view()
+        {
+            if (hits.empty() && !qcores.empty())
+                _get_pixelframe_from_qcores();
+
+            return hits;
+        }
+
+        /** @brief Returns the sub-events of the event, one per trigger after the first */
+        const std::vector<Event> &sub_events() const { return events; }
+
+        /**
+         * @brief Retrieves the hits of the event and its sub-events as a HitBuffer, one frame per trigger
+         *
+         * @return The hits of every trigger
+         */
+        HitBuffer get_hit_buffer();
+
+        /**
+         * @brief Create a string from the data of this class
+         *
+         * @return A string containing the data of this class
+         */
+        std::string as_str() const;
+
+        void set_debug(bool debug) { this->debug = debug; }
+
+        /** The StreamConfig object that contains the configuration parameters */
+        StreamConfig config;
+
+        /** The event header */
+        StreamHeader header;
+    private:
+
+        /**
+         * @brief debug
+         */
+        bool debug = false;
+
+        /** The vector of hits in the event */
+        std::vector<HitCoord> hits;
+
+        /** The vector of QuarterCore objects representing the quarter cores in the event */
+        std::vector<QuarterCore> qcores;
+
+        /** The vector of sub-events in the event */
+        std::vector<Event> events;
+
+        /**
+         * @brief Retrieves the quarter core data in the event
+         *
+         * @return A vector of tuples containing the serialized quarter core data
+         */
+        std::vector<std::tuple<uint8_t, word_t, DataTags>> _retrieve_qcore_data();
+
+        /**
+         * @brief Writes the quarter cores of the event into a stream
+         *
+         * @param writer The writer of the stream
+         */
+        void _write_qcores(BitWriter &writer) const;
+
+        /**
+         * @brief Prints the fields of the serialized event, one line per word
+         */
+        void _print_fields();
+
+        /**
+         * @brief Retrieves the quarter cores in the event
+         *
+         * The hits are bucketed in a dense grid of the quarter cores of the chip, which is walked in encoding order.
+         *
+         * @throws std::out_of_range If a hit lies outside of the chip
+         */
+        void _get_qcores_from_pixelframe();
+
+        /**
+         * @brief Retrieves the pixel frame in the event
+         *
+         * This function retrieves the pixel frame in the event by calling the
+         * _get_pixelframe_from_qcores() method of each QuarterCore object in the qcores vector.
+         */
+        void _get_pixelframe_from_qcores();
+    
+        friend class Decoder;
+    };
+
+    /**
+     * @brief Represents a TEPXEvent object.
+     *
+     * The TEPXEvent class encapsulates the details of a TEPX event, which includes vectors of hits,
+     * quarter cores, and sub-events. It provides methods to retrieve and manipulate this event data.
+     */
+    class TEPXEvent
+    {
+    public:
+        TEPXEvent() = default;
+
+        /**
+         * @brief Constructs an Event object
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param hits The vector of hits in the event
+         */
+        TEPXEvent(const StreamConfig &config, const StreamHeader &header, const std::vector<HitCoord> &hits);
+
+        /**
+         * @brief Constructs an Event object with hits
+         *
+         * This constructor initializes an Event object using a given configuration,
+         * header, and a nested vector of hits.
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param hits A nested vector of HitCoord objects representing the hits in the event, without any frame every chip
+         * gets one empty frame
+         */
+        TEPXEvent(const StreamConfig &config, const StreamHeader &header, const std::vector<std::vector<HitCoord>> &frames_);
+
+        /**
+         * @brief Constructs a TEPXEvent object from the frames of a HitBuffer
+         *
+         * Like the constructor from nested vectors, a buffer without frames gives every chip one empty frame.
+         *
+         * @param config The StreamConfig object that contains the configuration parameters
+         * @param header The StreamHeader object that contains the header of the event
+         * @param hits The module hits of every frame
+         */
+        TEPXEvent(const StreamConfig &config, const StreamHeader &header, const HitBuffer &hits);
+
+        /** The StreamConfig object that contains the configuration parameters */
+        const StreamConfig config;
+
+        /** The event header */
+        const StreamHeader header;
+
+        /**
+         * @brief serialize the event
+         *
+         * The four chips can be encoded concurrently. Starting a thread costs about as much as encoding a few hundred
+         * hits, so by default the chips are only encoded in parallel when the module has at least
+         * MIN_PARALLEL_HITS hits. If encoding a chip throws, the exception of the first failing chip is rethrown after
+         * all workers have finished.
+         *
+         * The threads are started per call instead of being kept in a pool. The emulator serializes one trigger at a
+         * time, and such events stay far below MIN_PARALLEL_HITS, so they are encoded on the calling thread without
+         * starting any thread. Only events that are large enough to gain from the threads pay for starting them.
+         *
+         * @param n_threads The number of threads encoding the chips (at most 4), 0 to encode serially below
+         * MIN_PARALLEL_HITS hits and on all hardware threads above
+         * @return std::array<std::vector<word_t>, 4> The stream of every chip, indexed by chip ID
+         */
+        std::array<std::vector<word_t>, 4> serialize_event(unsigned n_threads = 0);
+
+        /** @brief The number of module hits from which serialize_event encodes the chips in parallel by default */
+        static constexpr size_t MIN_PARALLEL_HITS = 20000;
+
+        /**
+         * @brief Returns the number of hits of all chips and frames
+         */
+        size_t n_hits() const { return n_hits_; }
+
+        /**
+         * @brief Get the chip
+         * 
+         * @param chip_id 
+         * @return const Event 
+         */
+        const Event get_chip(uint8_t chip_id) const { return chips[chip_id]; }
+
+    private:
+        /**
+         * @brief Builds the event of every chip from the hits routed to it, in chip coordinates
+         */
+        void _set_chips(const std::array<std::vector<std::vector<HitCoord>>, 4> &subframes);
+
+        std::array<Event, 4> chips;
+
+        /** @brief The number of hits of all chips and frames */
+        size_t n_hits_ = 0;
+    };
+
+
+    /**
+     * @brief A class for decoding streams of RD53 event data
+     */
+    class Decoder
+    {
+    public:
+        /**
+         * @brief Constructs a new Decoder object over caller-owned memory
+         *
+         * The words are decoded in place, they are not copied and must outlive the decoder.
+         *
+         * The decoded triggers take their memory from the given resource. With an Arena which is reset between streams,
+         * decoding does not allocate from the heap once the arena has grown to the size of a stream.
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         * @param stream A view of the 64-bit words containing the event data stream
+         * @param resource The memory resource of the decoded triggers, must outlive the decoder
+         */
+        Decoder(const StreamConfig &config, StreamView stream, std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Constructs a new Decoder object over caller-owned memory
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         * @param words Pointer to the 64-bit words containing the event data stream, must outlive the decoder
+         * @param n_words The number of words in the stream
+         */
+        Decoder(const StreamConfig &config, const word_t *words, size_t n_words);
+
+        /**
+         * @brief Constructs a new Decoder object
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         * @param words The vector of 64-bit unsigned integers containing the event data stream, must outlive the decoder
+         */
+        Decoder(const StreamConfig &config, const std::vector<word_t> &words);
+
+        /**
+         * @brief Constructs a new Decoder object which takes ownership of the stream
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         * @param words The vector of 64-bit unsigned integers containing the event data stream
+         */
+        Decoder(const StreamConfig &config, std::vector<word_t> &&words);
+
+        Decoder(const Decoder &) = delete;
+        Decoder &operator=(const Decoder &) = delete;
+
+        Decoder(Decoder &&) = default;
+
+        /**
+         * @brief Decodes the event data stream
+         */
+        void process_stream();
+
+        /**
+         * @brief Decodes the event data stream straight into pixel hits
+         *
+         * No QuarterCore objects are built, the hits are appended to the buffer while decoding. Reusing the buffer
+         * between streams avoids any allocation once it is large enough.
+         *
+         * @param hits The buffer the hits are appended to
+         * @return The number of hits appended
+         */
+        size_t decode_hits(std::vector<PixelHit> &hits);
+
+        /**
+         * @brief Decodes the event data stream straight into a HitBuffer
+         *
+         * Like the PixelHit overload, but the hits are written into the column, row and ToT arrays of the buffer and
+         * every trigger in the stream is appended as a frame, also when it has no hits.
+         *
+         * @param hits The buffer the frames are appended to
+         * @return The number of hits appended
+         */
+        size_t decode_hits(HitBuffer &hits);
+
+        /**
+         * @brief Decodes only the hitmaps of the event data stream and counts the hits per pixel
+         *
+         * The ToTs are skipped without being read and no QuarterCore objects are built, which is all online
+         * monitoring needs. The counters of all triggers in the stream are accumulated, so the same array can be
+         * passed for many streams.
+         *
+         * @param occupancy The hit counter of every pixel of the chip, indexed by col * height + row. An empty
+         * vector is resized to the chip, any other size is rejected.
+         * @return The number of hits counted
+         */
+        size_t decode_occupancy(std::vector<uint32_t> &occupancy);
+
+        /**
+         * @brief Returns the triggers decoded by process_stream as an event, every trigger after the first is a sub-event
+         */
+        Event get_event() const;
+
+        /**
+         * @brief Returns the decoded triggers as an event and releases them from the decoder
+         *
+         * Unlike get_event the decoder no longer holds the triggers afterwards, its batch is empty.
+         */
+        Event take_event();
+
+        /**
+         * @brief Moves the decoded triggers out of the decoder without copying them
+         *
+         * The decoder is left with an empty batch on the same memory resource.
+         */
+        EventBatch take_batch();
+
+        /**
+         * @brief Returns the triggers decoded by process_stream in flat storage
+         *
+         * The batch is owned by the decoder and reused by the next call to process_stream.
+         */
+        const EventBatch &get_batch() const { return batch_; }
+
+        /**
+         * @brief Reads the header of the first trigger of a stream without decoding the stream
+         *
+         * Only the chip ID, the trigger tag and, if the configuration has them, the extra IDs at the start of the
+         * stream are read, so this is cheap enough to run on every stream of a capture.
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         * @param stream The words of the stream, must not be empty
+         * @return The header of the first trigger
+         */
+        static StreamHeader peek_header(const StreamConfig &config, StreamView stream);
+
+        void set_debug(bool debug) { this->debug = debug; }
+
+        /** @brief The maximum number of bits a single step of the decoder state machine consumes */
+        static constexpr size_t MAX_STEP_BITS = 64;
+
+    private:
+        /**
+         * @brief Resets the decoder to the start of the event data stream
+         */
+        void _start();
+
+        /**
+         * @brief What the decoding loop turns the decoded quarter cores into
+         */
+        enum class Output
+        {
+            /** @brief QuarterCore objects, grouped per trigger in batch_ */
+            QCORES,
+            /** @brief PixelHit entries appended to hits_ */
+            HITS,
+            /** @brief Hits appended to the frames of hit_buffer_ */
+            HIT_BUFFER,
+            /** @brief Hit counters in occupancy_, the ToTs are skipped */
+            OCCUPANCY
+        };
+
+        /**
+         * @brief The stream flags a decoding loop is specialized on
+         *
+         * Every combination is compiled separately, so the flags cost nothing while decoding. The chip ID and the
+         * trigger IDs are left out, they only matter once per stream or once per word.
+         */
+        template <bool CompressedHitmap, bool DropTot, bool Debug, Output O>
+        struct Flags
+        {
+            static constexpr bool compressed_hitmap = CompressedHitmap;
+            static constexpr bool drop_tot = DropTot;
+            static constexpr bool debug = Debug;
+            static constexpr Output output = O;
+            static constexpr bool hits = O == Output::HITS || O == Output::HIT_BUFFER;
+        };
+
+        /** @brief A specialization of the decoding loop */
+        using DecodeFn = bool (Decoder::*)(size_t);
+
+        /**
+         * @brief Returns the decoding loop specialized on the configuration and the debug flag
+         *
+         * @tparam O What the decoded quarter cores are turned into
+         */
+        template <Output O>
+        DecodeFn _select_decoder() const;
+
+        /**
+         * @brief Runs the decoding loop selected at the start of the stream
+         *
+         * @param limit The bit position up to which the stream is available, a field is only decoded while it is
+         * guaranteed to end before the limit
+         * @return false once the end of the stream has been reached
+         */
+        bool _decode(size_t limit) { return (this->*decode_)(limit); }
+
+        /**
+         * @brief Decodes fields until the end of the stream or the limit is reached
+         *
+         * @tparam F The Flags the loop is specialized on
+         * @param limit The bit position up to which the stream is available
+         * @return false once the end of the stream has been reached
+         */
+        template <typename F>
+        bool _decode_as(size_t limit);
+
+        /**
+         * @brief Points the decoder at a new location of the stream, keeping the bit position
+         *
+         * @param stream The new view of the event data stream, which continues the old one
+         * @param dropped The number of words of the old view that the new one no longer starts with
+         */
+        void _rebind(StreamView stream, size_t dropped = 0);
+
+        /**
+         * @brief Validates the chip ID field
+         */
+        void _validate_chip_id();
+
+        /**
+         * @brief Gets the trigger IDs from the event data stream
+         *
+         * @return The next decoder state
+         */
+        template <typename F>
+        DataTags _get_trigger_ids();
+
+        /**
+         * @brief Stores the 16 bits of extra IDs in the header fields the configuration assigns them to
+         */
+        static void _set_trigger_ids(const StreamConfig &config, StreamHeader &header, uint16_t ids);
+
+        /**
+         * @brief Gets the trigger tag from the event data stream
+         *
+         * @return The next decoder state
          */
-        void _get_trigger_tag();
+        template <typename F>
+        DataTags _get_trigger_tag();
 
         /**
          * @brief Gets the column index from the event data stream
+         *
+         * @return The next decoder state
          */
-        void _get_col();
+        template <typename F>
+        DataTags _get_col();
 
         /**
          * @brief Gets the is_neighbour and is_last fields from the event data stream
+         *
+         * @return The next decoder state
          */
-        void _get_neighbour_and_last();
+        template <typename F>
+        DataTags _get_neighbour_and_last();
 
         /**
          * @brief Gets the row index from the event data stream
+         *
+         * @return The next decoder state
+         */
+        template <typename F>
+        DataTags _get_row();
+
+        /**
+         * @brief Gets the hitmap field from the event data stream
+         *
+         * @return The next decoder state
+         */
+        template <typename F>
+        DataTags _get_hitmap();
+
+        /**
+         * @brief Gets the tot values of the hits in the current hitmap in a single read
+         *
+         * @return The next decoder state
          */
-        void _get_row();
+        template <typename F>
+        DataTags _get_tots();
 
         /**
-         * @brief Gets the hitmap and tot fields from the event data stream
+         * @brief Stores the current quarter core in the current event
+         *
+         * @return The next decoder state
          */
-        void _get_hitmap();
+        template <typename F>
+        DataTags _push_qcore();
 
         /**
-         * @brief Calculates the tot value from the number of hits
+         * @brief Appends the hits of the current quarter core to hits_ or to the current frame of hit_buffer_
          *
-         * @param n_hits The number of hits
-         * @return The tot value
+         * @param hit_raw The hitmap of the quarter core
+         * @param packed The ToTs of the hits, the lowest hit index in the lowest nibble
+         * @return The next decoder state
          */
-        uint64_t _get_tots(uint16_t n_hits);
+        template <typename F>
+        DataTags _push_hits(uint16_t hit_raw, uint64_t packed);
 
         /**
-         * @brief Shifts the bit index of the event data stream
+         * @brief Counts the hits of all quarter cores up to the last one of the current column
+         *
+         * Used instead of the per field handlers when decoding the occupancy. The quarter cores of a column are
+         * decoded in a single loop, which may consume more than MAX_STEP_BITS.
          *
-         * @param bit_index The new bit index
-         * @param remove_start Whether to remove the start bit
-         * @return The shifted value
+         * @return The next decoder state
          */
-        inline word_t _shift_stream(size_t bit_index);
+        template <typename F>
+        DataTags _count_column();
 
         /**
-         * @brief Gets the specified number of bits from the event data stream
+         * @brief Reads the specified number of bits from the event data stream
          *
-         * @param n_bits The number of bits to get
-         * @param increment Whether to increment the bit index
+         * @param n_bits The number of bits to read
          * @return The bits as a 64-bit unsigned integer
          */
-        inline word_t _get_nbits(uint8_t n_bits, bool increment = true);
+        template <typename F>
+        inline word_t _get_nbits(uint8_t n_bits);
+
+        /**
+         * @brief Prints a decoded field for debugging
+         *
+         * @param value The bits of the field
+         * @param n_bits The width of the field
+         */
+        void _print_field(word_t value, uint8_t n_bits) const;
 
         /**
          * @brief Indicates the start of a new event
@@ -722,49 +1650,315 @@ namespace RD53
         bool debug = false;
 
         /**
-         * @brief The bit index of the event data stream
+         * @brief The field the decoder state machine is currently processing
+         */
+        DataTags state_;
+
+        /** @brief The decoding loop specialized on the configuration, selected at the start of the stream */
+        DecodeFn decode_;
+
+        /** @brief Reader over the payload bits of the event data stream */
+        BitReader reader_;
+
+        /** @brief Storage for a stream handed over to the decoder, empty when decoding caller-owned memory */
+        std::vector<word_t> owned_;
+
+        /** @brief The event data stream */
+        StreamView stream_;
+
+        /** @brief The StreamConfig object containing the configuration parameters */
+        const StreamConfig config_;
+
+        /** @brief The triggers of the event data stream */
+        EventBatch batch_;
+
+        /** @brief A pointer to the header of the current trigger */
+        StreamHeader *current_header_;
+
+        /** @brief The buffer hits are appended to when decoding into pixel hits */
+        std::vector<PixelHit> *hits_;
+
+        /** @brief The buffer hits are appended to when decoding into a HitBuffer */
+        HitBuffer *hit_buffer_;
+
+        /** @brief The frame of hit_buffer_ the first trigger of the stream is written to */
+        size_t first_frame_;
+
+        /** @brief The column and row of every hit index inside a quarter core, the table of the qcore geometry */
+        const std::array<qcore_layout::Pixel, 16> *pixel_of_;
+
+        /** @brief The hit counters of the pixels when decoding the occupancy */
+        uint32_t *occupancy_;
+
+        /** @brief The number of hits counted when decoding the occupancy */
+        size_t n_counted_;
+
+        QuarterCore qc_;
+
+        friend class StreamDecoder;
+    };
+
+    /**
+     * @brief A push-style decoder for event data arriving in arbitrary chunks
+     *
+     * Words are fed in chunks that do not need to line up with stream boundaries. The decoder keeps its state
+     * between calls and makes every trigger available as an Event as soon as it is completely decoded, so data can
+     * be decoded while it is still arriving.
+     */
+    class StreamDecoder
+    {
+    public:
+        /**
+         * @brief Constructs a new StreamDecoder object
+         *
+         * @param config The StreamConfig object containing the configuration parameters
+         */
+        StreamDecoder(const StreamConfig &config);
+
+        /**
+         * @brief Feeds the next chunk of words to the decoder
+         *
+         * The words are copied, only the part of a stream that is not decoded yet is kept.
+         *
+         * A stream that fails to decode is dropped up to its end of stream word, only the events of its triggers that were
+         * completed before the error stay queued. The streams after it are decoded as usual, and the first error of the
+         * chunk is rethrown once the whole chunk has been consumed.
+         *
+         * @param words The next words of the data
+         * @return The number of events completed by this chunk
          */
-        size_t bit_index_;
+        size_t push(StreamView words);
 
         /**
-         * @brief The jump size of the event data stream
+         * @brief Returns whether completed events are waiting to be retrieved
          */
-        size_t jump_size_;
+        bool has_events() const { return !ready_.empty(); }
 
         /**
-         * @brief The size of a word in bits
+         * @brief Retrieves and removes all completed events
+         *
+         * @return The completed events, one per trigger, in stream order
          */
-        uint8_t word_size_;
+        std::vector<Event> pop_events();
 
         /**
-         * @brief The size of the meta data in bits
+         * @brief Returns the number of words of the current stream kept for decoding
          */
-        uint8_t word_meta_size_;
+        size_t n_buffered_words() const { return buffer_.size(); }
 
-        /** @brief The event data stream */
-        std::vector<word_t> stream_;
+        void set_debug(bool debug) { decoder_.set_debug(debug); }
+
+    private:
+        /**
+         * @brief Appends words of a single stream and decodes as far as possible
+         *
+         * @param words The words, of which only the last one may carry the end of stream bit
+         * @param complete Whether the last word ends the stream
+         */
+        void _append(StreamView words, bool complete);
+
+        /**
+         * @brief Moves the completed events of the decoder to the output queue
+         *
+         * @param finished Whether the current event is complete as well
+         */
+        void _emit(bool finished);
+
+        /**
+         * @brief Discards the words and the triggers of the current stream
+         */
+        void _reset();
+
+        /** @brief The decoder running on the words of the current stream */
+        Decoder decoder_;
+
+        /** @brief The received words of the current stream */
+        std::vector<word_t> buffer_;
+
+        /** @brief Completed events waiting to be retrieved */
+        std::vector<Event> ready_;
+
+        /** @brief The number of events of the current stream that have been emitted */
+        size_t emitted_;
+
+        /** @brief The chip ID of the current stream */
+        uint8_t chip_id_;
+
+        /** @brief Whether the words up to the next end of stream are discarded */
+        bool skipping_;
+    };
+
+
+    /**
+     * @brief Decodes batches of independent streams in parallel
+     *
+     * Every stream is decoded by its own Decoder on one of the worker threads, so the streams of different chips or
+     * triggers can be decoded concurrently.
+     */
+    class ParallelDecoder
+    {
+    public:
+        /**
+         * @brief Constructs a new ParallelDecoder object
+         *
+         * @param config The StreamConfig object containing the configuration parameters of all streams
+         * @param n_threads The number of worker threads, 0 to use all hardware threads
+         */
+        ParallelDecoder(const StreamConfig &config, unsigned n_threads = 0);
+
+        /**
+         * @brief Decodes a batch of streams
+         *
+         * The words are decoded in place and must stay valid during the call. If decoding a stream throws, the
+         * exception of the first failing stream is rethrown after all workers have finished.
+         *
+         * @param streams Views of the independent streams
+         * @return The decoded events in the order of the input streams
+         */
+        std::vector<Event> decode(const std::vector<StreamView> &streams) const;
+
+        /**
+         * @brief Returns the number of worker threads
+         */
+        unsigned get_n_threads() const { return n_threads_; }
 
+    private:
         /** @brief The StreamConfig object containing the configuration parameters */
         const StreamConfig config_;
 
-        /** @brief The vector of pairs representing the events in the event data stream */
-        using EventVec = std::vector<std::pair<StreamHeader, std::vector<QuarterCore>>>;
+        /** @brief The number of worker threads */
+        unsigned n_threads_;
+    };
+
+    /**
+     * @brief A sidecar index of the streams of a capture file, for random access to single streams and trigger ranges
+     *
+     * Building the index scans the capture once and reads only the header at the start of every stream. The index is
+     * saved next to the capture as a small binary file (a header followed by the raw StreamIndexEntry records, 24
+     * bytes per stream), so later reads load it and decode only the streams they need instead of rescanning the
+     * capture.
+     */
+    class CaptureIndex
+    {
+    public:
+        /**
+         * @brief Builds the index of all complete streams of a capture
+         *
+         * @param capture The capture file
+         * @param config The StreamConfig object of the streams, the chip ID and extra IDs are read as it defines them
+         */
+        CaptureIndex(const CaptureFile &capture, const StreamConfig &config);
 
-        /** @brief The vector of pairs representing the events in the event data stream */
-        EventVec events_;
+        /**
+         * @brief Loads an index saved by save()
+         *
+         * Throws std::runtime_error if the file cannot be read or is not an index.
+         *
+         * @param path The path of the index file
+         */
+        static CaptureIndex load(const std::string &path);
 
-        /** @brief An iterator pointing to the current event in the events vector */
-        EventVec::iterator current_event_;
+        /**
+         * @brief Loads the sidecar index of a capture, or builds and saves it if it is missing or out of date
+         *
+         * Throws std::runtime_error if a new index cannot be saved.
+         *
+         * @param capture The capture file
+         * @param config The StreamConfig object of the streams
+         */
+        static CaptureIndex open(const CaptureFile &capture, const StreamConfig &config);
 
-        /** @brief A pointer to the header of the current event */
-        StreamHeader *current_header_;
+        /**
+         * @brief Returns the path of the sidecar index of a capture file
+         */
+        static std::string sidecar_path(const std::string &capture_path) { return capture_path + ".idx"; }
 
-        /** @brief A pointer to the vector of QuarterCore objects of the current event */
-        std::vector<QuarterCore> *current_qcores_;
+        /**
+         * @brief Writes the index to a file
+         *
+         * Throws std::runtime_error if the file cannot be written.
+         *
+         * @param path The path of the index file
+         */
+        void save(const std::string &path) const;
 
-        QuarterCore qc_;
-    };
+        /**
+         * @brief Returns whether the index was built from this capture with the same header configuration
+         *
+         * The capture is compared by its size, inode and modification time, so an index of a capture that grew or was
+         * overwritten since is out of date. The first and the last indexed stream must also end on an end of stream.
+         */
+        bool matches(const CaptureFile &capture, const StreamConfig &config) const;
+
+        /** @brief Returns the number of indexed streams */
+        size_t size() const { return entries_.size(); }
+
+        /** @brief Returns the entries of all streams, in file order */
+        const std::vector<StreamIndexEntry> &entries() const { return entries_; }
+
+        /** @brief Returns the entry of a stream, throws std::out_of_range for an invalid index */
+        const StreamIndexEntry &at(size_t stream) const { return entries_.at(stream); }
+
+        /**
+         * @brief Finds the next stream whose first trigger has a trigger tag
+         *
+         * Trigger tags wrap around, so the search starts at a stream and returns the first match at or after it.
+         *
+         * @param trigger_tag The trigger tag
+         * @param from The first stream to look at
+         * @return The index of the stream, or size() if there is none
+         */
+        size_t find_trigger_tag(uint8_t trigger_tag, size_t from = 0) const;
+
+        /**
+         * @brief Returns a stream of the capture without scanning for it
+         *
+         * Throws std::out_of_range for an invalid index and std::invalid_argument if the indexed words are not a stream
+         * of the capture, i.e. lie outside of it or do not start after and end with an end of stream word.
+         *
+         * @param capture The capture file the index was built from
+         * @param stream The index of the stream
+         */
+        StreamView stream(const CaptureFile &capture, size_t stream) const;
 
+        /**
+         * @brief Returns a range of streams of the capture without scanning for them
+         *
+         * @param capture The capture file the index was built from
+         * @param first The index of the first stream
+         * @param last The index after the last stream, clamped to size()
+         */
+        std::vector<StreamView> streams(const CaptureFile &capture, size_t first, size_t last) const;
+
+    private:
+        CaptureIndex() = default;
+
+        /**
+         * @brief Returns whether an entry starts after and ends with an end of stream word of the capture
+         */
+        static bool _is_stream(const CaptureFile &capture, const StreamIndexEntry &entry);
+
+        /** @brief The number of words of the indexed capture */
+        uint64_t n_capture_words_ = 0;
+
+        /** @brief The inode number of the indexed capture */
+        uint64_t capture_inode_ = 0;
+
+        /** @brief The modification time of the indexed capture, in ns since the epoch */
+        int64_t capture_mtime_ns_ = 0;
+
+        /** @brief Whether the chip ID was read from the streams */
+        bool chip_id_ = false;
+
+        /** @brief Whether the BCID was read from the streams */
+        bool bcid_ = false;
+
+        /** @brief Whether the L1ID was read from the streams */
+        bool l1id_ = false;
+
+        /** @brief The entries of all streams, in file order */
+        std::vector<StreamIndexEntry> entries_;
+    };
 };
 
 #endif // RD53EVENT_H
@@ -0,0 +1,127 @@
+/**
+ * @file Tots.h
+ * @brief Expansion and packing of the ToT values of a quarter core
+ *
+ * The ToT values of a quarter core follow its hitmap in the stream as one contiguous block of 4 bits per hit,
+ * starting with the hit of the highest index. QuarterCore stores them as 16 nibbles, nibble i holding the ToT of
+ * hit i, so the block has to be scattered into the nibbles selected by the hitmap.
+ */
+
+#ifndef TOTS_H
+#define TOTS_H
+
+#include <cstdint>
+
+namespace RD53
+{
+    namespace tots
+    {
+        /**
+         * @brief Counts the hits of a hitmap, which is the number of ToT values following it
+         *
+         * Without hardware popcount enabled __builtin_popcount is a library call, this stays inline.
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @return The number of set bits
+         */
+        constexpr uint8_t count(uint16_t hit_raw)
+        {
+            uint32_t bits = hit_raw - ((hit_raw >> 1) & 0x5555);
+            bits = (bits & 0x3333) + ((bits >> 2) & 0x3333);
+            bits = (bits + (bits >> 4)) & 0x0F0F;
+
+            return (bits + (bits >> 8)) & 0x1F;
+        }
+
+        /**
+         * @brief Scatters packed ToT values into the nibbles of the set bits of the hitmap, one bit at a time
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param packed The block of 4 * popcount(hit_raw) ToT bits as read from the stream, right aligned
+         * @return The ToT values in the layout of QuarterCore::set_hit_raw
+         */
+        inline uint64_t expand_portable(uint16_t hit_raw, uint64_t packed)
+        {
+            uint64_t tots = 0;
+
+            // the last ToT in the stream belongs to the lowest hit index
+            for (uint32_t hits = hit_raw; hits != 0; hits &= hits - 1)
+            {
+                tots |= (packed & 0xF) << (__builtin_ctz(hits) * 4);
+                packed >>= 4;
+            }
+
+            return tots;
+        }
+
+        /**
+         * @brief Scatters packed ToT values with a single parallel bit deposit
+         *
+         * Only available when the CPU supports BMI2, see has_bmi2.
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param packed The block of 4 * popcount(hit_raw) ToT bits as read from the stream, right aligned
+         * @return The ToT values in the layout of QuarterCore::set_hit_raw
+         */
+        uint64_t expand_bmi2(uint16_t hit_raw, uint64_t packed);
+
+        /**
+         * @brief Gathers the ToT values of the set bits of the hitmap into the block written to the stream, one bit at
+         * a time
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param tots The ToT values in the layout of QuarterCore::set_hit_raw
+         * @return The block of 4 * popcount(hit_raw) ToT bits, right aligned
+         */
+        inline uint64_t compress_portable(uint16_t hit_raw, uint64_t tots)
+        {
+            uint64_t packed = 0;
+            uint8_t shift = 0;
+
+            for (uint32_t hits = hit_raw; hits != 0; hits &= hits - 1, shift += 4)
+                packed |= (tots >> (__builtin_ctz(hits) * 4) & 0xF) << shift;
+
+            return packed;
+        }
+
+        /**
+         * @brief Gathers the ToT values of the set bits of the hitmap with a single parallel bit extract
+         *
+         * Only available when the CPU supports BMI2, see has_bmi2.
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param tots The ToT values in the layout of QuarterCore::set_hit_raw
+         * @return The block of 4 * popcount(hit_raw) ToT bits, right aligned
+         */
+        uint64_t compress_bmi2(uint16_t hit_raw, uint64_t tots);
+
+        /** @brief Whether expand_bmi2() and compress_bmi2() can be used on this CPU, detected once at load time */
+        extern const bool has_bmi2;
+
+        /**
+         * @brief Scatters packed ToT values into the nibbles of the set bits of the hitmap
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param packed The block of 4 * popcount(hit_raw) ToT bits as read from the stream, right aligned
+         * @return The ToT values in the layout of QuarterCore::set_hit_raw
+         */
+        inline uint64_t expand(uint16_t hit_raw, uint64_t packed)
+        {
+            return has_bmi2 ? expand_bmi2(hit_raw, packed) : expand_portable(hit_raw, packed);
+        }
+
+        /**
+         * @brief Gathers the ToT values of the set bits of the hitmap into the block written to the stream
+         *
+         * @param hit_raw The hitmap of the quarter core
+         * @param tots The ToT values in the layout of QuarterCore::set_hit_raw
+         * @return The block of 4 * popcount(hit_raw) ToT bits, right aligned
+         */
+        inline uint64_t compress(uint16_t hit_raw, uint64_t tots)
+        {
+            return has_bmi2 ? compress_bmi2(hit_raw, tots) : compress_portable(hit_raw, tots);
+        }
+    };
+};
+
+#endif // TOTS_H
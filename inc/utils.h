@@ -35,7 +35,8 @@ enum class DataTags
     S2,
     S3,
     HITPAIR,
-    TOT
+    TOT,
+    END_OF_STREAM
 };
 
 std::ostream &operator<<(std::ostream &os, DataTags tag);
@@ -68,7 +69,7 @@ enum class Color
 
 
 // Map to connect DataTags enum to their ANSI escape codes for foreground & background
-static std::map<DataTags, std::pair<Color, Color>> data_tag_colors = {
+static const std::map<DataTags, std::pair<Color, Color>> data_tag_colors = {
     {DataTags::TRIGGER_TAG, {Color::YELLOW, Color::RESET}},
     {DataTags::EXTRA_IDS, {Color::CYAN, Color::RESET}},
     {DataTags::COLUMN, {Color::GREEN, Color::RESET}},
@@ -86,7 +87,7 @@ static std::map<DataTags, std::pair<Color, Color>> data_tag_colors = {
 using ansi_map_t = std::map<Color, std::string>;
 
 // Map to connect Color enum to their ANSI escape codes for foreground
-static ansi_map_t fgc = {
+static const ansi_map_t fgc = {
     {Color::BLACK, "\033[30m"},
     {Color::RED, "\033[31m"},
     {Color::GREEN, "\033[32m"},
@@ -109,7 +110,7 @@ static ansi_map_t fgc = {
 };
 
 // Map to connect Color enum to their ANSI escape codes for background
-static ansi_map_t bgc = {
+static const ansi_map_t bgc = {
     {Color::BLACK, "\033[40m"},
     {Color::RED, "\033[41m"},
     {Color::GREEN, "\033[42m"},
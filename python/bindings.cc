@@ -2,6 +2,8 @@
 #include <cstdint>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <pybind11/operators.h>
 #include "RD53Event.h"
 #include "utils.h"
 
@@ -40,6 +42,7 @@ PYBIND11_MODULE(RD53Eventpy, m)
          .value("S3", DataTags::S3)
          .value("HITPAIR", DataTags::HITPAIR)
          .value("TOT", DataTags::TOT)
+         .value("END_OF_STREAM", DataTags::END_OF_STREAM)
          .export_values();
 
      // Bind StreamHeader class
@@ -104,7 +107,7 @@ PYBIND11_MODULE(RD53Eventpy, m)
               "Returns a 2D vector representing the hit map of the QuarterCore.")
          .def("get_binary_tree", &RD53::QuarterCore::get_binary_tree,
               "Returns the binary tree representation of the hit map.")
-         .def("serialize_qcore", &RD53::QuarterCore::serialize_qcore,
+         .def("serialize_qcore", py::overload_cast<bool>(&RD53::QuarterCore::serialize_qcore, py::const_),
               py::arg("prev_last_in_col"),
               "Serializes the quarter core data into a vector of tuples.")
          .def("hit_index", &RD53::QuarterCore::hit_index,
@@ -142,6 +145,146 @@ PYBIND11_MODULE(RD53Eventpy, m)
          .def("__eq__", &RD53::QuarterCore::operator==,
               "Checks if two QuarterCore objects are equal.");
 
+     // Bind HitBuffer class, the arrays are returned as copies, since push_back and add_frame may move the storage
+     py::class_<RD53::HitBuffer>(m, "HitBuffer", "Structure of arrays container for the pixel hits of one or more frames.")
+         .def(py::init<>(),
+              "Constructs an empty HitBuffer without frames.")
+         .def(py::init<const std::vector<RD53::HitCoord> &>(),
+              py::arg("hits"),
+              "Constructs a HitBuffer with a single frame.")
+         .def(py::init<const std::vector<std::vector<RD53::HitCoord>> &>(),
+              py::arg("frames"),
+              "Constructs a HitBuffer with a frame per list of hits.")
+         .def("add_frame", py::overload_cast<>(&RD53::HitBuffer::add_frame),
+              "Starts a new, empty frame.")
+         .def("add_frame", py::overload_cast<const std::vector<RD53::HitCoord> &>(&RD53::HitBuffer::add_frame),
+              py::arg("hits"),
+              "Appends a frame.")
+         .def("push_back", &RD53::HitBuffer::push_back,
+              py::arg("col"), py::arg("row"), py::arg("tot"),
+              "Appends a hit to the last frame.")
+         .def("clear", &RD53::HitBuffer::clear,
+              "Removes all hits and frames.")
+         .def("n_frames", &RD53::HitBuffer::n_frames,
+              "Returns the number of frames.")
+         .def("get_frame", &RD53::HitBuffer::get_frame,
+              py::arg("frame"),
+              "Returns the hits of a frame as a list of (col, row, tot) tuples.")
+         .def("get_frames", &RD53::HitBuffer::get_frames,
+              "Returns the hits of every frame as lists of (col, row, tot) tuples.")
+         .def_property_readonly("col", [](const RD53::HitBuffer &self)
+                                { return py::array_t<uint16_t>(self.cols().size(), self.cols().data()); },
+                                "A copy of the column of every hit.")
+         .def_property_readonly("row", [](const RD53::HitBuffer &self)
+                                { return py::array_t<uint16_t>(self.rows().size(), self.rows().data()); },
+                                "A copy of the row of every hit.")
+         .def_property_readonly("tot", [](const RD53::HitBuffer &self)
+                                { return py::array_t<uint8_t>(self.tots().size(), self.tots().data()); },
+                                "A copy of the ToT of every hit.")
+         .def_property_readonly("offsets", [](const RD53::HitBuffer &self)
+                                { return py::array_t<size_t>(self.offsets().size(), self.offsets().data()); },
+                                "A copy of the index of the first hit of every frame followed by the number of hits.")
+         .def("__len__", &RD53::HitBuffer::size)
+         .def("__eq__", &RD53::HitBuffer::operator==);
+
+     // Bind EventBatch class
+     py::class_<RD53::EventBatch>(m, "EventBatch", "The triggers of a stream in flat storage: one quarter core array with offsets per trigger.")
+         .def(py::init<const RD53::StreamConfig &>(),
+              py::arg("config") = RD53::StreamConfig(),
+              "Constructs an empty EventBatch.")
+         .def("n_triggers", &RD53::EventBatch::n_triggers,
+              "Returns the number of triggers.")
+         .def("headers", &RD53::EventBatch::headers,
+              "Returns the header of every trigger.")
+         .def("qcore_offsets", [](const RD53::EventBatch &self)
+              { return py::array_t<size_t>(self.qcore_offsets().size(), self.qcore_offsets().data()); },
+              "Returns the index of the first quarter core of every trigger followed by the number of quarter cores.")
+         .def("get_qcores", [](const RD53::EventBatch &self, size_t trigger)
+              {
+                   auto qcores = self.get_qcores(trigger);
+                   return std::vector<RD53::QuarterCore>(qcores.begin(), qcores.end()); },
+              py::arg("trigger"),
+              "Returns the quarter cores of a trigger.")
+         .def("get_hits", &RD53::EventBatch::get_hits,
+              "Returns the hits of all triggers as a HitBuffer, one frame per trigger.")
+         .def("get_event", &RD53::EventBatch::get_event,
+              py::arg("trigger"),
+              "Returns a single trigger as an Event object.")
+         .def("get_config", &RD53::EventBatch::get_config,
+              "Returns the configuration of all triggers.")
+         .def("__len__", &RD53::EventBatch::n_triggers);
+
+     // Bind ChipBitmap class
+     py::class_<RD53::ChipBitmap>(m, "ChipBitmap", "A bit per pixel of the chip, telling whether it was hit.")
+         .def(py::init<const RD53::StreamConfig &>(),
+              py::arg("config") = RD53::StreamConfig(),
+              "Constructs an empty ChipBitmap for the quarter core size of the configuration.")
+         .def(py::init([](const RD53::EventBatch &batch, size_t trigger)
+                       { return RD53::ChipBitmap(batch.get_config(), batch.get_qcores(trigger)); }),
+              py::arg("batch"), py::arg("trigger") = 0,
+              "Constructs a ChipBitmap with the hits of one trigger of an EventBatch.")
+         .def("add", py::overload_cast<const RD53::QuarterCore &>(&RD53::ChipBitmap::add),
+              py::arg("qcore"),
+              "Sets the pixels hit in a quarter core.")
+         .def("set", &RD53::ChipBitmap::set,
+              py::arg("col"), py::arg("row"),
+              "Sets a single pixel.")
+         .def("test", &RD53::ChipBitmap::test,
+              py::arg("col"), py::arg("row"),
+              "Returns whether a pixel is set.")
+         .def("to_qcores", &RD53::ChipBitmap::to_qcores,
+              "Returns the quarter cores of the set pixels in encoding order, with all ToTs 0.")
+         .def("count", &RD53::ChipBitmap::count,
+              "Returns the number of set pixels.")
+         .def("none", &RD53::ChipBitmap::none,
+              "Returns whether no pixel is set.")
+         .def("clear", &RD53::ChipBitmap::clear,
+              "Clears all pixels.")
+         .def_property_readonly("words", [](py::object self)
+                                {
+                                     const auto &words = self.cast<const RD53::ChipBitmap &>().words();
+                                     return py::array_t<uint64_t>(words.size(), words.data(), self); },
+                                "The words of the bitmap, pixel (col, row) is bit col * height + row.")
+         .def(py::self & py::self)
+         .def(py::self | py::self)
+         .def(py::self ^ py::self)
+         .def(py::self &= py::self)
+         .def(py::self |= py::self)
+         .def(py::self ^= py::self)
+         .def(~py::self)
+         .def(py::self == py::self);
+
+     // Bind PixelHistogram class, the counters are exposed as numpy views shaped like the chip
+     py::class_<RD53::PixelHistogram>(m, "PixelHistogram", "Per-pixel hit counts and ToT histograms accumulated from decoded quarter cores.")
+         .def(py::init<const RD53::StreamConfig &>(),
+              py::arg("config") = RD53::StreamConfig(),
+              "Constructs an empty PixelHistogram for the quarter core size of the configuration.")
+         .def("fill", py::overload_cast<const RD53::QuarterCore &>(&RD53::PixelHistogram::fill),
+              py::arg("qcore"),
+              "Adds the hits of a quarter core.")
+         .def("fill", py::overload_cast<const RD53::EventBatch &>(&RD53::PixelHistogram::fill),
+              py::arg("batch"), py::call_guard<py::gil_scoped_release>(),
+              "Adds the hits of all triggers of an EventBatch.")
+         .def("merge", &RD53::PixelHistogram::merge,
+              py::arg("other"),
+              "Adds the counters of another histogram.")
+         .def("clear", &RD53::PixelHistogram::clear,
+              "Sets all counters to zero.")
+         .def("n_hits", &RD53::PixelHistogram::n_hits,
+              "Returns the total number of hits filled.")
+         .def_property_readonly("hits", [](py::object self)
+                                {
+                                     const auto &histogram = self.cast<const RD53::PixelHistogram &>();
+                                     std::vector<py::ssize_t> shape = {py::ssize_t(histogram.width()), py::ssize_t(histogram.height())};
+                                     return py::array_t<uint32_t>(shape, histogram.hit_counts().data(), self); },
+                                "The hit count of every pixel as a (col, row) view.")
+         .def_property_readonly("tots", [](py::object self)
+                                {
+                                     const auto &histogram = self.cast<const RD53::PixelHistogram &>();
+                                     std::vector<py::ssize_t> shape = {py::ssize_t(histogram.width()), py::ssize_t(histogram.height()), py::ssize_t(RD53::PixelHistogram::N_TOT_BINS)};
+                                     return py::array_t<uint32_t>(shape, histogram.tot_counts().data(), self); },
+                                "The ToT histogram of every pixel as a (col, row, tot) view.");
+
      // Bind Event class
      py::class_<RD53::Event>(m, "Event", "Represents an Event object containing hits in the RD53 detector.")
          .def(py::init<>(),
@@ -155,12 +298,22 @@ PYBIND11_MODULE(RD53Eventpy, m)
          .def(py::init<const RD53::StreamConfig &, const RD53::StreamHeader &, std::vector<RD53::QuarterCore> &>(),
               py::arg("config"), py::arg("header"), py::arg("qcores"),
               "Constructs an Event object with specified configuration, header, and quarter cores.")
+         .def(py::init<const RD53::StreamConfig &, const RD53::StreamHeader &, const RD53::HitBuffer &>(),
+              py::arg("config"), py::arg("header"), py::arg("hits"),
+              "Constructs an Event object from a HitBuffer, every frame after the first becomes a sub-event.")
+         .def(py::init<const RD53::EventBatch &>(),
+              py::arg("batch"),
+              "Constructs an Event object from an EventBatch, every trigger after the first becomes a sub-event.")
          .def("serialize_event", &RD53::Event::serialize_event,
               "Serializes the event data into a vector of 64-bit integers.")
          .def("get_qcores", &RD53::Event::get_qcores,
               "Retrieves the vector of QuarterCore objects representing the quarter cores in the event.")
          .def("get_hits", &RD53::Event::get_hits,
               "Retrieves the vector of hits in the event.")
+         .def("get_hit_buffer", &RD53::Event::get_hit_buffer,
+              "Retrieves the hits of the event and its sub-events as a HitBuffer, one frame per trigger.")
+         .def("sub_events", &RD53::Event::sub_events,
+              "Returns copies of the sub-events of the event, one per trigger after the first.")
          .def("as_str", &RD53::Event::as_str,
               "Returns a string representation of the Event object.")
          .def("set_debug", &RD53::Event::set_debug, "Sets the debug flag for the Event object.", py::arg("debug") = false)
@@ -175,21 +328,223 @@ PYBIND11_MODULE(RD53Eventpy, m)
          .def(py::init<const RD53::StreamConfig &, const RD53::StreamHeader &, const std::vector<std::vector<RD53::HitCoord>> &>(),
               py::arg("config"), py::arg("header"), py::arg("frames"),
               "Constructs a TEPXEvent object with specified configuration, header, and nested vector of hits.")
-         .def("serialize_event", &RD53::TEPXEvent::serialize_event,
-              "Serializes the TEPXEvent data into an array of vectors of 64-bit integers.")
+         .def(py::init<const RD53::StreamConfig &, const RD53::StreamHeader &, const RD53::HitBuffer &>(),
+              py::arg("config"), py::arg("header"), py::arg("hits"),
+              "Constructs a TEPXEvent object from the module hits of every frame of a HitBuffer.")
+         .def("serialize_event", &RD53::TEPXEvent::serialize_event, py::arg("n_threads") = 0,
+              py::call_guard<py::gil_scoped_release>(),
+              "Serializes the TEPXEvent data into an array of vectors of 64-bit integers, encoding the chips concurrently. n_threads = 0 uses all hardware threads.")
          .def("get_chip", &RD53::TEPXEvent::get_chip, py::arg("chip_id"), "Retrieves the Event object for the specified chip.")
          .def_readonly("config", &RD53::TEPXEvent::config, "The StreamConfig object that contains the configuration parameters.")
          .def_readonly("header", &RD53::TEPXEvent::header, "The StreamHeader object that contains the header of the event.");
      // Note: Since the TEPXEvent class does not expose methods to get frames or chips, we only bind what's available.
 
+     // Bind PixelHit as numpy record
+     PYBIND11_NUMPY_DTYPE(RD53::PixelHit, col, row, tot, event);
+     PYBIND11_NUMPY_DTYPE(RD53::Cluster, col_min, col_max, row_min, row_max, size, tot, event);
+     PYBIND11_NUMPY_DTYPE(RD53::StreamIndexEntry, offset, n_words, bcid, l1id, chip_id, trigger_tag, trigger_pos);
+
+     // Bind Clusterer class
+     py::class_<RD53::Clusterer>(m, "Clusterer", "Groups the hits of decoded quarter cores into clusters of 8-connected pixels.")
+         .def(py::init<const RD53::StreamConfig &>(),
+              py::arg("config") = RD53::StreamConfig(),
+              "Constructs a Clusterer for the quarter core size of the configuration.")
+         .def("cluster", [](RD53::Clusterer &self, const RD53::EventBatch &batch)
+              {
+                   std::vector<RD53::Cluster> clusters;
+
+                   {
+                        py::gil_scoped_release release;
+                        self.cluster(batch, clusters);
+                   }
+
+                   return py::array_t<RD53::Cluster>(clusters.size(), clusters.data()); },
+              py::arg("batch"),
+              "Clusters every trigger of an EventBatch into a numpy array with fields col_min, col_max, row_min, row_max, size, tot and event.");
+
      // Bind Decoder class
      py::class_<RD53::Decoder>(m, "Decoder", "A class for decoding streams of RD53 event data.")
-         .def(py::init<const RD53::StreamConfig &, std::vector<RD53::word_t> &>(),
+         .def(py::init([](const RD53::StreamConfig &config, py::array words)
+                       {
+                            // contiguous uint64 arrays are decoded in place, anything else is converted once
+                            if (py::isinstance<py::array_t<RD53::word_t, py::array::c_style>>(words))
+                                return RD53::Decoder(config, static_cast<const RD53::word_t *>(words.data()), words.size());
+
+                            return RD53::Decoder(config, words.cast<std::vector<RD53::word_t>>()); }),
+              py::arg("config"), py::arg("words"), py::keep_alive<1, 3>(),
+              "Constructs a new Decoder object over a numpy array without copying it.")
+         .def(py::init([](const RD53::StreamConfig &config, std::vector<RD53::word_t> words)
+                       { return RD53::Decoder(config, std::move(words)); }),
               py::arg("config"), py::arg("words"),
               "Constructs a new Decoder object with the specified configuration and event data stream.")
          .def("process_stream", &RD53::Decoder::process_stream,
               "Decodes the event data stream.")
          .def("get_event", &RD53::Decoder::get_event,
               "Returns the list of decoded Event objects.")
+         .def("get_batch", &RD53::Decoder::get_batch, py::return_value_policy::copy,
+              "Returns a copy of the triggers decoded by process_stream as an EventBatch.")
+         .def("take_event", &RD53::Decoder::take_event,
+              "Returns the decoded triggers as an Event and releases them from the decoder.")
+         .def("take_batch", &RD53::Decoder::take_batch,
+              "Moves the decoded triggers out of the decoder as an EventBatch.")
+         .def("decode_hits", [](RD53::Decoder &self)
+              {
+                   std::vector<RD53::PixelHit> hits;
+
+                   self.decode_hits(hits);
+
+                   return py::array_t<RD53::PixelHit>(hits.size(), hits.data()); },
+              "Decodes the event data stream straight into a numpy array of pixel hits with fields col, row, tot and event.")
+         .def("decode_hit_buffer", [](RD53::Decoder &self)
+              {
+                   RD53::HitBuffer hits;
+
+                   self.decode_hits(hits);
+
+                   return hits; },
+              "Decodes the event data stream straight into a HitBuffer with a frame per trigger.")
+         .def("decode_occupancy", [](RD53::Decoder &self)
+              {
+                   std::vector<uint32_t> occupancy;
+
+                   self.decode_occupancy(occupancy);
+
+                   return py::array_t<uint32_t>(occupancy.size(), occupancy.data()); },
+              "Decodes only the hitmaps of the event data stream and returns the hit count of every pixel, indexed by col * height + row.")
          .def("set_debug", &RD53::Decoder::set_debug, "Sets the debug flag for the Decoder object.", py::arg("debug") = false);
+
+     // Bind StreamDecoder class
+     py::class_<RD53::StreamDecoder>(m, "StreamDecoder", "A push-style decoder for event data arriving in arbitrary chunks.")
+         .def(py::init<const RD53::StreamConfig &>(),
+              py::arg("config"),
+              "Constructs a new StreamDecoder object with the specified configuration.")
+         .def("push", [](RD53::StreamDecoder &self, const std::vector<RD53::word_t> &words)
+              { return self.push(RD53::StreamView(words)); },
+              py::arg("words"),
+              "Feeds the next chunk of words and returns the number of events it completed.")
+         .def("has_events", &RD53::StreamDecoder::has_events,
+              "Returns whether completed events are waiting to be retrieved.")
+         .def("pop_events", &RD53::StreamDecoder::pop_events,
+              "Retrieves and removes all completed events, one per trigger.")
+         .def("set_debug", &RD53::StreamDecoder::set_debug, "Sets the debug flag for the StreamDecoder object.", py::arg("debug") = false);
+
+     // Bind ParallelDecoder class
+     py::class_<RD53::ParallelDecoder>(m, "ParallelDecoder", "Decodes batches of independent streams in parallel.")
+         .def(py::init<const RD53::StreamConfig &, unsigned>(),
+              py::arg("config"), py::arg("n_threads") = 0,
+              "Constructs a new ParallelDecoder object, n_threads = 0 uses all hardware threads.")
+         .def("decode", [](const RD53::ParallelDecoder &self, const std::vector<std::vector<RD53::word_t>> &streams)
+              {
+                   std::vector<RD53::StreamView> views(streams.begin(), streams.end());
+
+                   py::gil_scoped_release release;
+
+                   return self.decode(views); },
+              py::arg("streams"),
+              "Decodes a list of streams and returns one Event per stream in input order.")
+         .def("get_n_threads", &RD53::ParallelDecoder::get_n_threads,
+              "Returns the number of worker threads.");
+
+     // Bind CaptureFile class, streams are read-only numpy views into the mapping which keep the file mapped
+     auto capture_view = [](py::object capture, RD53::StreamView words)
+     {
+          py::array_t<RD53::word_t> view = words.empty() ? py::array_t<RD53::word_t>(0) : py::array_t<RD53::word_t>(words.size, words.data, capture);
+          view.attr("setflags")(py::arg("write") = false);
+          return view;
+     };
+
+     py::class_<RD53::CaptureFile>(m, "CaptureFile", "A memory mapped raw capture file, iterated stream by stream without loading it.")
+         .def(py::init<const std::string &>(),
+              py::arg("path"),
+              "Maps a capture file of raw 64-bit words.")
+         .def("next", [capture_view](py::object self) -> py::object
+              {
+                   RD53::StreamView stream;
+
+                   if (!self.cast<RD53::CaptureFile &>().next(stream))
+                        return py::none();
+
+                   return capture_view(self, stream); },
+              "Returns the next stream as a uint64 view, or None once all complete streams have been read.")
+         .def("__iter__", [](py::object self)
+              { return self; })
+         .def("__next__", [capture_view](py::object self)
+              {
+                   RD53::StreamView stream;
+
+                   if (!self.cast<RD53::CaptureFile &>().next(stream))
+                        throw py::stop_iteration();
+
+                   return capture_view(self, stream); })
+         .def("rewind", &RD53::CaptureFile::rewind,
+              "Moves back to the first stream.")
+         .def("position", &RD53::CaptureFile::position,
+              "Returns the offset of the next stream in words.")
+         .def("streams", [capture_view](py::object self)
+              {
+                   py::list views;
+
+                   for (RD53::StreamView stream : self.cast<const RD53::CaptureFile &>().streams())
+                        views.append(capture_view(self, stream));
+
+                   return views; },
+              "Returns views of all complete streams in file order.")
+         .def("words", [capture_view](py::object self)
+              { return capture_view(self, self.cast<const RD53::CaptureFile &>().words()); },
+              "Returns all words of the file as a uint64 view.")
+         .def("n_words", &RD53::CaptureFile::n_words,
+              "Returns the number of words of the file.")
+         .def("n_trailing_words", &RD53::CaptureFile::n_trailing_words,
+              "Returns the number of words after the last end of stream.")
+         .def_property_readonly("path", &RD53::CaptureFile::path,
+              "The path of the file.")
+         .def("inode", &RD53::CaptureFile::inode,
+              "Returns the inode number of the file when it was mapped.")
+         .def("mtime_ns", &RD53::CaptureFile::mtime_ns,
+              "Returns the last modification time of the file when it was mapped, in ns since the epoch.");
+
+     // Bind CaptureIndex class
+     py::class_<RD53::CaptureIndex>(m, "CaptureIndex", "A sidecar index of the stream offsets and first trigger headers of a capture file.")
+         .def(py::init<const RD53::CaptureFile &, const RD53::StreamConfig &>(),
+              py::arg("capture"), py::arg("config"),
+              "Builds the index of all complete streams of a capture.")
+         .def_static("load", &RD53::CaptureIndex::load,
+                     py::arg("path"),
+                     "Loads an index saved by save().")
+         .def_static("open", &RD53::CaptureIndex::open,
+                     py::arg("capture"), py::arg("config"),
+                     "Loads the sidecar index of a capture, or builds and saves it if it is missing or out of date.")
+         .def_static("sidecar_path", &RD53::CaptureIndex::sidecar_path,
+                     py::arg("capture_path"),
+                     "Returns the path of the sidecar index of a capture file.")
+         .def("save", &RD53::CaptureIndex::save,
+              py::arg("path"),
+              "Writes the index to a file.")
+         .def("matches", &RD53::CaptureIndex::matches,
+              py::arg("capture"), py::arg("config"),
+              "Returns whether the index was built from this capture with the same header configuration.")
+         .def("__len__", &RD53::CaptureIndex::size)
+         .def("entries", [](const RD53::CaptureIndex &self)
+              {
+                   const auto &entries = self.entries();
+
+                   return py::array_t<RD53::StreamIndexEntry>(entries.size(), entries.data()); },
+              "Returns a numpy array with fields offset, n_words, bcid, l1id, chip_id, trigger_tag and trigger_pos per stream.")
+         .def("find_trigger_tag", &RD53::CaptureIndex::find_trigger_tag,
+              py::arg("trigger_tag"), py::arg("start") = 0,
+              "Returns the next stream at or after start whose first trigger has the tag, or len(index) if there is none.")
+         .def("stream", [capture_view](const RD53::CaptureIndex &self, py::object capture, size_t stream)
+              { return capture_view(capture, self.stream(capture.cast<const RD53::CaptureFile &>(), stream)); },
+              py::arg("capture"), py::arg("stream"),
+              "Returns a stream of the capture as a uint64 view, without scanning for it.")
+         .def("streams", [capture_view](const RD53::CaptureIndex &self, py::object capture, size_t first, size_t last)
+              {
+                   py::list views;
+
+                   for (RD53::StreamView stream : self.streams(capture.cast<const RD53::CaptureFile &>(), first, last))
+                        views.append(capture_view(capture, stream));
+
+                   return views; },
+              py::arg("capture"), py::arg("first"), py::arg("last"),
+              "Returns the streams first to last (exclusive) of the capture as uint64 views.");
 }
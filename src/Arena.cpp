@@ -0,0 +1,86 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace RD53;
+
+Arena::Arena(size_t block_size, std::pmr::memory_resource *upstream)
+    : upstream_(upstream), block_size_(std::max<size_t>(block_size, 64)), blocks_(), current_(0), used_(0), n_allocations_(0), n_upstream_allocations_(0)
+{
+}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void Arena::reset()
+{
+    current_ = 0;
+    used_ = 0;
+}
+
+void Arena::release()
+{
+    for (auto &block : blocks_)
+        upstream_->deallocate(block.data, block.size, alignof(std::max_align_t));
+
+    blocks_.clear();
+
+    reset();
+}
+
+size_t Arena::bytes_used() const
+{
+    if (blocks_.empty())
+        return 0;
+
+    size_t bytes = used_;
+
+    for (size_t i = 0; i < current_; i++)
+        bytes += blocks_[i].size;
+
+    return bytes;
+}
+
+size_t Arena::capacity() const
+{
+    size_t bytes = 0;
+
+    for (auto &block : blocks_)
+        bytes += block.size;
+
+    return bytes;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment)
+{
+    n_allocations_++;
+
+    while (true)
+    {
+        // continue in the next kept block whenever the current one is too small, the rest of it stays unused until reset
+        for (; current_ < blocks_.size(); current_++, used_ = 0)
+        {
+            Block &block = blocks_[current_];
+
+            uintptr_t address = reinterpret_cast<uintptr_t>(block.data) + used_;
+            size_t padding = (alignment - address % alignment) % alignment;
+
+            if (used_ + padding + bytes <= block.size)
+            {
+                used_ += padding + bytes;
+                return block.data + used_ - bytes;
+            }
+        }
+
+        size_t size = std::max(blocks_.empty() ? block_size_ : blocks_.back().size * 2, bytes + alignment);
+
+        blocks_.push_back({static_cast<char *>(upstream_->allocate(size, alignof(std::max_align_t))), size});
+        n_upstream_allocations_++;
+
+        current_ = blocks_.size() - 1;
+        used_ = 0;
+    }
+}
@@ -0,0 +1,101 @@
+#include "BinaryTree.h"
+
+using namespace RD53;
+
+namespace
+{
+    /**
+     * @brief A bit source over a table key of LUT_BITS bits, which records whether the code fits in the key
+     */
+    struct KeySource
+    {
+        uint32_t key;
+        uint8_t position;
+
+        constexpr uint8_t peek2() const
+        {
+            // bits beyond the key read as zero, an overlong code is caught through the position
+            if (position >= binary_tree::LUT_BITS)
+                return 0;
+
+            uint32_t window = (key << 2) >> (binary_tree::LUT_BITS - position);
+            return window & 0b11;
+        }
+
+        constexpr void skip(uint8_t n_bits) { position += n_bits; }
+    };
+
+    /**
+     * @brief Adapts a BitReader to the bit source interface of decode_hitmap
+     */
+    struct ReaderSource
+    {
+        BitReader &reader;
+
+        uint8_t peek2() { return reader.peek(2); }
+
+        void skip(uint8_t n_bits) { reader.skip(n_bits); }
+    };
+
+    constexpr std::array<binary_tree::LutEntry, 1 << binary_tree::LUT_BITS> make_decode_table()
+    {
+        std::array<binary_tree::LutEntry, 1 << binary_tree::LUT_BITS> table{};
+
+        for (uint32_t key = 0; key < table.size(); key++)
+        {
+            KeySource source{key, 0};
+
+            uint16_t hit_raw = binary_tree::decode_hitmap(source);
+
+            if (source.position <= binary_tree::LUT_BITS)
+                table[key] = {hit_raw, source.position};
+        }
+
+        return table;
+    }
+
+    constexpr std::array<uint32_t, 1 << 16> make_encode_table()
+    {
+        // the code of a hitmap is its root node followed by the codes of its halves, which only have 256 values
+        std::array<binary_tree::Code, 1 << 8> halves{};
+
+        for (uint32_t hits = 0; hits < halves.size(); hits++)
+            halves[hits] = binary_tree::encode_half(hits);
+
+        std::array<uint32_t, 1 << 16> table{};
+
+        for (uint32_t hit_raw = 0; hit_raw < table.size(); hit_raw++)
+        {
+            uint8_t first = hit_raw & 0xFF, second = hit_raw >> 8;
+
+            binary_tree::Code code;
+
+            code.node(first != 0, second != 0);
+
+            if (first != 0)
+                code.append(halves[first]);
+
+            if (second != 0)
+                code.append(halves[second]);
+
+            table[hit_raw] = uint32_t(1) << code.length | code.bits;
+        }
+
+        return table;
+    }
+
+    // evaluated by the compiler, so the tables live in the read-only data of the library
+    constexpr auto DECODE_TABLE = make_decode_table();
+    constexpr auto ENCODE_TABLE = make_encode_table();
+}
+
+const std::array<binary_tree::LutEntry, 1 << binary_tree::LUT_BITS> binary_tree::decode_table = DECODE_TABLE;
+
+const std::array<uint32_t, 1 << 16> binary_tree::encode_table = ENCODE_TABLE;
+
+uint16_t binary_tree::decode_slow(BitReader &reader)
+{
+    ReaderSource source{reader};
+
+    return decode_hitmap(source);
+}
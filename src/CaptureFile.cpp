@@ -0,0 +1,149 @@
+#include "CaptureFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace RD53;
+
+CaptureFile::CaptureFile(const std::string &path) : path_(path), words_(nullptr), n_words_(0), n_complete_words_(0), position_(0), inode_(0), mtime_ns_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throw std::runtime_error("Cannot open capture file " + path + ": " + std::strerror(errno));
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Cannot stat capture file " + path + ": " + std::strerror(error));
+    }
+
+    size_t size = info.st_size;
+
+    inode_ = info.st_ino;
+    mtime_ns_ = int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+
+    if (size % sizeof(word_t) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Capture file " + path + " has " + std::to_string(size) + " bytes, which is not a whole number of words");
+    }
+
+    if (size != 0)
+    {
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping == MAP_FAILED)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Cannot map capture file " + path + ": " + std::strerror(error));
+        }
+
+        // streams are read front to back, so the kernel may read ahead aggressively and drop pages behind the reader
+        ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+        words_ = static_cast<const word_t *>(mapping);
+        n_words_ = size / sizeof(word_t);
+    }
+
+    // the mapping keeps the file referenced
+    ::close(fd);
+
+    n_complete_words_ = n_words_;
+
+    while (n_complete_words_ > 0 && (words_[n_complete_words_ - 1] >> 63) == 0)
+        n_complete_words_--;
+}
+
+CaptureFile::~CaptureFile()
+{
+    _unmap();
+}
+
+CaptureFile::CaptureFile(CaptureFile &&other) noexcept
+    : path_(std::move(other.path_)), words_(std::exchange(other.words_, nullptr)), n_words_(std::exchange(other.n_words_, 0)),
+      n_complete_words_(std::exchange(other.n_complete_words_, 0)), position_(std::exchange(other.position_, 0)),
+      inode_(std::exchange(other.inode_, 0)), mtime_ns_(std::exchange(other.mtime_ns_, 0))
+{
+}
+
+CaptureFile &CaptureFile::operator=(CaptureFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        _unmap();
+
+        path_ = std::move(other.path_);
+        words_ = std::exchange(other.words_, nullptr);
+        n_words_ = std::exchange(other.n_words_, 0);
+        n_complete_words_ = std::exchange(other.n_complete_words_, 0);
+        position_ = std::exchange(other.position_, 0);
+        inode_ = std::exchange(other.inode_, 0);
+        mtime_ns_ = std::exchange(other.mtime_ns_, 0);
+    }
+
+    return *this;
+}
+
+void CaptureFile::_unmap()
+{
+    if (words_ != nullptr)
+        ::munmap(const_cast<word_t *>(words_), n_words_ * sizeof(word_t));
+
+    words_ = nullptr;
+}
+
+void CaptureFile::seek(size_t position)
+{
+    if (position > n_complete_words_)
+        throw std::out_of_range("Offset " + std::to_string(position) + " is past the last stream of " + path_);
+
+    position_ = position;
+}
+
+StreamView CaptureFile::stream_at(size_t position) const
+{
+    if (position >= n_complete_words_)
+        throw std::out_of_range("No stream starts at offset " + std::to_string(position) + " of " + path_);
+
+    // the last word of the complete streams has the bit set, so the scan never runs past it
+    size_t end = position;
+
+    while ((words_[end] >> 63) == 0)
+        end++;
+
+    return StreamView(words_ + position, end + 1 - position);
+}
+
+bool CaptureFile::next(StreamView &stream)
+{
+    if (position_ >= n_complete_words_)
+        return false;
+
+    stream = stream_at(position_);
+    position_ += stream.size;
+
+    return true;
+}
+
+std::vector<StreamView> CaptureFile::streams() const
+{
+    std::vector<StreamView> views;
+
+    for (size_t begin = 0; begin < n_complete_words_; begin += views.back().size)
+        views.push_back(stream_at(begin));
+
+    return views;
+}
@@ -0,0 +1,209 @@
+#include "RD53Event.h"
+
+#include <cstring>
+#include <string>
+
+using namespace RD53;
+
+static_assert(sizeof(StreamIndexEntry) == 24 && std::is_trivially_copyable_v<StreamIndexEntry>, "the entries are stored as raw records");
+
+namespace
+{
+    /** @brief Identifies an index file, the last byte is the format version */
+    constexpr char MAGIC[8] = {'R', 'D', '5', '3', 'I', 'D', 'X', 2};
+
+    /**
+     * @brief The header at the start of an index file, followed by the entries
+     */
+    struct IndexHeader
+    {
+        char magic[8];
+        uint32_t entry_size;
+        uint8_t chip_id;
+        uint8_t bcid;
+        uint8_t l1id;
+        uint8_t reserved;
+        uint64_t n_capture_words;
+        uint64_t capture_inode;
+        int64_t capture_mtime_ns;
+        uint64_t n_entries;
+    };
+}
+
+CaptureIndex::CaptureIndex(const CaptureFile &capture, const StreamConfig &config)
+    : n_capture_words_(capture.n_words()), capture_inode_(capture.inode()), capture_mtime_ns_(capture.mtime_ns()), chip_id_(config.chip_id), bcid_(config.bcid), l1id_(config.l1id), entries_()
+{
+    size_t end = capture.n_words() - capture.n_trailing_words();
+
+    for (size_t offset = 0; offset < end;)
+    {
+        StreamView stream = capture.stream_at(offset);
+
+        if (stream.size > UINT32_MAX)
+            throw std::runtime_error("Stream at offset " + std::to_string(offset) + " of " + capture.path() + " is too long to index");
+
+        StreamHeader header = Decoder::peek_header(config, stream);
+
+        StreamIndexEntry entry{};
+        entry.offset = offset;
+        entry.n_words = stream.size;
+        entry.bcid = header.bcid;
+        entry.l1id = header.l1id;
+        entry.chip_id = header.chip_id;
+        entry.trigger_tag = header.trigger_tag;
+        entry.trigger_pos = header.trigger_pos;
+
+        entries_.push_back(entry);
+
+        offset += stream.size;
+    }
+}
+
+CaptureIndex CaptureIndex::load(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file)
+        throw std::runtime_error("Cannot open index file " + path);
+
+    IndexHeader header;
+
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.entry_size != sizeof(StreamIndexEntry))
+        throw std::runtime_error(path + " is not an index file of this version");
+
+    CaptureIndex index;
+    index.n_capture_words_ = header.n_capture_words;
+    index.capture_inode_ = header.capture_inode;
+    index.capture_mtime_ns_ = header.capture_mtime_ns;
+    index.chip_id_ = header.chip_id;
+    index.bcid_ = header.bcid;
+    index.l1id_ = header.l1id;
+
+    // read in chunks, so a damaged entry count cannot make a huge allocation up front
+    constexpr size_t CHUNK = 64 * 1024;
+
+    for (uint64_t n_read = 0; n_read < header.n_entries;)
+    {
+        size_t n = std::min<uint64_t>(CHUNK, header.n_entries - n_read);
+
+        index.entries_.resize(n_read + n);
+
+        if (!file.read(reinterpret_cast<char *>(index.entries_.data() + n_read), n * sizeof(StreamIndexEntry)))
+            throw std::runtime_error("Index file " + path + " is truncated");
+
+        n_read += n;
+    }
+
+    if (file.peek() != std::ifstream::traits_type::eof())
+        throw std::runtime_error("Index file " + path + " has trailing data");
+
+    for (const StreamIndexEntry &entry : index.entries_)
+    {
+        if (entry.offset + entry.n_words > index.n_capture_words_)
+            throw std::runtime_error("Index file " + path + " has a stream outside of the capture");
+    }
+
+    return index;
+}
+
+CaptureIndex CaptureIndex::open(const CaptureFile &capture, const StreamConfig &config)
+{
+    std::string path = sidecar_path(capture.path());
+
+    if (std::ifstream(path).good())
+    {
+        try
+        {
+            CaptureIndex index = load(path);
+
+            if (index.matches(capture, config))
+                return index;
+        }
+        catch (const std::runtime_error &)
+        {
+            // a damaged index is rebuilt like an outdated one
+        }
+    }
+
+    CaptureIndex index(capture, config);
+    index.save(path);
+
+    return index;
+}
+
+void CaptureIndex::save(const std::string &path) const
+{
+    IndexHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.entry_size = sizeof(StreamIndexEntry);
+    header.chip_id = chip_id_;
+    header.bcid = bcid_;
+    header.l1id = l1id_;
+    header.n_capture_words = n_capture_words_;
+    header.capture_inode = capture_inode_;
+    header.capture_mtime_ns = capture_mtime_ns_;
+    header.n_entries = entries_.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries_.data()), entries_.size() * sizeof(StreamIndexEntry));
+    file.close();
+
+    if (!file)
+        throw std::runtime_error("Cannot write index file " + path);
+}
+
+bool CaptureIndex::matches(const CaptureFile &capture, const StreamConfig &config) const
+{
+    if (n_capture_words_ != capture.n_words() || capture_inode_ != capture.inode() || capture_mtime_ns_ != capture.mtime_ns())
+        return false;
+
+    if (chip_id_ != config.chip_id || bcid_ != config.bcid || l1id_ != config.l1id)
+        return false;
+
+    // a cheap check of the content, the modification time may not change when a capture is rewritten quickly
+    return entries_.empty() || (_is_stream(capture, entries_.front()) && _is_stream(capture, entries_.back()));
+}
+
+bool CaptureIndex::_is_stream(const CaptureFile &capture, const StreamIndexEntry &entry)
+{
+    if (entry.n_words == 0 || entry.offset + entry.n_words > capture.n_words())
+        return false;
+
+    const word_t *words = capture.words().data;
+
+    return (words[entry.offset + entry.n_words - 1] >> 63) != 0 && (entry.offset == 0 || (words[entry.offset - 1] >> 63) != 0);
+}
+
+size_t CaptureIndex::find_trigger_tag(uint8_t trigger_tag, size_t from) const
+{
+    for (size_t stream = from; stream < entries_.size(); stream++)
+    {
+        if (entries_[stream].trigger_tag == trigger_tag)
+            return stream;
+    }
+
+    return entries_.size();
+}
+
+StreamView CaptureIndex::stream(const CaptureFile &capture, size_t stream) const
+{
+    const StreamIndexEntry &entry = entries_.at(stream);
+
+    if (!_is_stream(capture, entry))
+        throw std::invalid_argument("Stream " + std::to_string(stream) + " of the index is not a stream of " + capture.path() + ", the index is out of date");
+
+    return StreamView(capture.words().data + entry.offset, entry.n_words);
+}
+
+std::vector<StreamView> CaptureIndex::streams(const CaptureFile &capture, size_t first, size_t last) const
+{
+    std::vector<StreamView> views;
+
+    for (size_t i = first; i < std::min(last, entries_.size()); i++)
+        views.push_back(stream(capture, i));
+
+    return views;
+}
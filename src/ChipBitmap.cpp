@@ -0,0 +1,213 @@
+#include "RD53Event.h"
+
+#include <string>
+
+using namespace RD53;
+
+static_assert(ChipBitmap::N_PIXELS % 64 == 0, "the pixels fill the words exactly");
+
+ChipBitmap::ChipBitmap(const StreamConfig &config)
+    : config_(config), wide_(config.size_qcore_horizontal == 8), qcore_width_(config.size_qcore_horizontal), qcore_height_(config.size_qcore_vertical),
+      width_(N_QCORES_HORIZONTAL * config.size_qcore_horizontal), height_(N_QCORES_VERTICAL * config.size_qcore_vertical), words_(N_WORDS, 0)
+{
+    // this rejects an unknown qcore size
+    QuarterCore probe(config_);
+}
+
+ChipBitmap::ChipBitmap(const StreamConfig &config, EventBatch::QcoreView qcores) : ChipBitmap(config)
+{
+    add(qcores);
+}
+
+void ChipBitmap::add(const QuarterCore &qcore)
+{
+    uint16_t hit_raw = qcore.get_hit_raw().first;
+
+    if (hit_raw == 0)
+        return;
+
+    uint8_t qcol = qcore.get_col(), qrow = qcore.get_row();
+
+    if (qcol >= N_QCORES_HORIZONTAL || qrow >= N_QCORES_VERTICAL)
+        throw std::out_of_range("Quarter core (" + std::to_string(qcol) + ", " + std::to_string(qrow) + ") is outside of the chip");
+
+    uint16_t pixels = qcore_layout::to_pixels(wide_, hit_raw);
+    uint16_t column_mask = (1 << qcore_height_) - 1;
+
+    size_t bit = qcol * qcore_width_ * height_ + qrow * qcore_height_;
+
+    for (uint8_t x = 0; x < qcore_width_; x++, bit += height_)
+        words_[bit / 64] |= uint64_t(pixels >> (x * qcore_height_) & column_mask) << (bit % 64);
+}
+
+void ChipBitmap::add(EventBatch::QcoreView qcores)
+{
+    for (const QuarterCore &qcore : qcores)
+        add(qcore);
+}
+
+void ChipBitmap::set(uint16_t col, uint16_t row)
+{
+    if (col >= width_ || row >= height_)
+        throw std::out_of_range("pixel (" + std::to_string(col) + ", " + std::to_string(row) + ") is outside of the chip");
+
+    size_t bit = col * height_ + row;
+
+    words_[bit / 64] |= uint64_t(1) << (bit % 64);
+}
+
+bool ChipBitmap::test(uint16_t col, uint16_t row) const
+{
+    if (col >= width_ || row >= height_)
+        throw std::out_of_range("pixel (" + std::to_string(col) + ", " + std::to_string(row) + ") is outside of the chip");
+
+    size_t bit = col * height_ + row;
+
+    return words_[bit / 64] >> (bit % 64) & 1;
+}
+
+inline uint64_t ChipBitmap::_read(size_t bit, uint8_t n_bits) const
+{
+    size_t word = bit / 64;
+    uint8_t shift = bit % 64;
+
+    uint64_t bits = words_[word] >> shift;
+
+    if (shift != 0 && word + 1 < N_WORDS)
+        bits |= words_[word + 1] << (64 - shift);
+
+    return n_bits == 64 ? bits : bits & ((uint64_t(1) << n_bits) - 1);
+}
+
+std::vector<QuarterCore> ChipBitmap::to_qcores() const
+{
+    std::vector<QuarterCore> qcores;
+
+    const size_t group_bits = qcore_width_ * height_;
+    const uint64_t qcore_mask = (uint64_t(1) << qcore_height_) - 1;
+
+    // columns are encoded from the highest to the lowest, the quarter cores of a column from the lowest row up
+    for (int qcol = N_QCORES_HORIZONTAL - 1; qcol >= 0; qcol--)
+    {
+        // the pixel columns of a quarter core column are whole words, skipped at once when empty
+        size_t first_word = qcol * group_bits / 64, last_word = ((qcol + 1) * group_bits - 1) / 64;
+
+        if (std::all_of(words_.begin() + first_word, words_.begin() + last_word + 1, [](uint64_t word)
+                        { return word == 0; }))
+            continue;
+
+        size_t n_before = qcores.size();
+        int prev_row = -2;
+
+        for (size_t row = 0; row < height_; row += 64)
+        {
+            uint8_t n_bits = std::min<size_t>(64, height_ - row);
+
+            // the same 64 rows of every pixel column of the quarter core column
+            std::array<uint64_t, 8> columns;
+            uint64_t any = 0;
+
+            for (uint8_t x = 0; x < qcore_width_; x++)
+            {
+                columns[x] = _read(qcol * group_bits + x * height_ + row, n_bits);
+                any |= columns[x];
+            }
+
+            while (any != 0)
+            {
+                uint8_t offset = __builtin_ctzll(any) / qcore_height_ * qcore_height_;
+                any &= ~(qcore_mask << offset);
+
+                uint16_t pixels = 0;
+
+                for (uint8_t x = 0; x < qcore_width_; x++)
+                    pixels |= (columns[x] >> offset & qcore_mask) << (x * qcore_height_);
+
+                uint8_t qrow = (row + offset) / qcore_height_;
+
+                QuarterCore qcore(config_, qcol, qrow);
+
+                qcore.set_hit_raw(qcore_layout::to_hits(wide_, pixels), 0);
+                qcore.set_is_neighbour(qrow == prev_row + 1);
+                qcores.push_back(qcore);
+
+                prev_row = qrow;
+            }
+        }
+
+        if (qcores.size() > n_before)
+            qcores.back().set_is_last(true);
+    }
+
+    if (!qcores.empty())
+        qcores.back().set_is_last_in_event(true);
+
+    return qcores;
+}
+
+size_t ChipBitmap::count() const
+{
+    size_t n_pixels = 0;
+
+    for (uint64_t word : words_)
+        n_pixels += __builtin_popcountll(word);
+
+    return n_pixels;
+}
+
+bool ChipBitmap::none() const
+{
+    return std::all_of(words_.begin(), words_.end(), [](uint64_t word)
+                       { return word == 0; });
+}
+
+void ChipBitmap::clear()
+{
+    std::fill(words_.begin(), words_.end(), 0);
+}
+
+void ChipBitmap::_check_size(const ChipBitmap &other) const
+{
+    if (other.qcore_width_ != qcore_width_ || other.qcore_height_ != qcore_height_)
+        throw std::invalid_argument("Cannot combine bitmaps of another quarter core size");
+}
+
+ChipBitmap &ChipBitmap::operator&=(const ChipBitmap &other)
+{
+    _check_size(other);
+
+    for (size_t i = 0; i < N_WORDS; i++)
+        words_[i] &= other.words_[i];
+
+    return *this;
+}
+
+ChipBitmap &ChipBitmap::operator|=(const ChipBitmap &other)
+{
+    _check_size(other);
+
+    for (size_t i = 0; i < N_WORDS; i++)
+        words_[i] |= other.words_[i];
+
+    return *this;
+}
+
+ChipBitmap &ChipBitmap::operator^=(const ChipBitmap &other)
+{
+    _check_size(other);
+
+    for (size_t i = 0; i < N_WORDS; i++)
+        words_[i] ^= other.words_[i];
+
+    return *this;
+}
+
+ChipBitmap ChipBitmap::operator~() const
+{
+    ChipBitmap flipped(*this);
+
+    for (uint64_t &word : flipped.words_)
+        word = ~word;
+
+    return flipped;
+}
@@ -0,0 +1,223 @@
+#include "RD53Event.h"
+
+#include <string>
+
+using namespace RD53;
+
+namespace
+{
+    /** @brief Marks a cell without components */
+    constexpr uint32_t NO_COMPONENT = UINT32_MAX;
+}
+
+Clusterer::Clusterer(const StreamConfig &config)
+    : config_(config), wide_(config.size_qcore_horizontal == 8), width_(config.size_qcore_horizontal), height_(config.size_qcore_vertical),
+      first_col_(0), first_row_(0), last_row_(0), cells_(N_QCORES_HORIZONTAL * N_QCORES_VERTICAL, {NO_COMPONENT, 0}), touched_(), components_()
+{
+    // this rejects an unknown qcore size
+    QuarterCore probe(config_);
+
+    for (uint8_t x = 0; x < width_; x++)
+    {
+        for (uint8_t y = 0; y < height_; y++)
+        {
+            uint8_t pixel = x * height_ + y;
+
+            if (x == 0)
+                first_col_ |= 1 << pixel;
+            if (y == 0)
+                first_row_ |= 1 << pixel;
+            if (y == height_ - 1)
+                last_row_ |= 1 << pixel;
+        }
+    }
+}
+
+inline uint16_t Clusterer::_dilate(uint16_t pixels) const
+{
+    // rows first, without wrapping into the neighbouring column, then whole columns
+    uint32_t grown = pixels | ((pixels << 1) & ~first_row_) | ((pixels >> 1) & ~last_row_);
+
+    return (grown | grown << height_ | grown >> height_) & 0xFFFF;
+}
+
+inline uint32_t Clusterer::_find(uint32_t component)
+{
+    while (components_[component].parent != component)
+    {
+        components_[component].parent = components_[components_[component].parent].parent;
+        component = components_[component].parent;
+    }
+
+    return component;
+}
+
+void Clusterer::_add_components(const QuarterCore &qcore, uint16_t event)
+{
+    auto [hit_raw, tots] = qcore.get_hit_raw();
+
+    if (hit_raw == 0)
+        return;
+
+    uint8_t qcol = qcore.get_col(), qrow = qcore.get_row();
+
+    if (qcol >= N_QCORES_HORIZONTAL || qrow >= N_QCORES_VERTICAL)
+        throw std::out_of_range("Quarter core (" + std::to_string(qcol) + ", " + std::to_string(qrow) + ") is outside of the chip");
+
+    uint32_t cell = qcol * N_QCORES_VERTICAL + qrow;
+
+    if (cells_[cell].count != 0)
+        throw std::invalid_argument("Quarter core (" + std::to_string(qcol) + ", " + std::to_string(qrow) + ") appears twice in a trigger");
+
+    cells_[cell].first = components_.size();
+    touched_.push_back(cell);
+
+    uint16_t remaining = qcore_layout::to_pixels(wide_, hit_raw);
+
+    while (remaining != 0)
+    {
+        // grow the lowest remaining pixel until the component stops changing
+        uint16_t pixels = remaining & -remaining;
+
+        for (uint16_t grown = _dilate(pixels) & remaining; grown != pixels; grown = _dilate(pixels) & remaining)
+            pixels = grown;
+
+        remaining &= ~pixels;
+
+        uint32_t tot = 0;
+        uint16_t rows = 0;
+
+        for (uint32_t bits = pixels; bits != 0; bits &= bits - 1)
+        {
+            uint8_t pixel = __builtin_ctz(bits);
+
+            tot += tots >> (qcore_layout::INDEX_OF[wide_][pixel] * 4) & 0xF;
+            rows |= 1 << (pixel % height_);
+        }
+
+        uint16_t col = qcol * width_, row = qrow * height_;
+
+        Cluster summary = {uint16_t(col + __builtin_ctz(pixels) / height_), uint16_t(col + (31 - __builtin_clz(pixels)) / height_),
+                           uint16_t(row + __builtin_ctz(rows)), uint16_t(row + 31 - __builtin_clz(rows)),
+                           uint32_t(__builtin_popcount(pixels)), tot, event};
+
+        uint32_t component = components_.size();
+        components_.push_back({cell, pixels, component, NO_COMPONENT, summary});
+        cells_[cell].count++;
+    }
+}
+
+void Clusterer::_join_neighbours(uint32_t component)
+{
+    uint16_t pixels = components_[component].pixels;
+    uint32_t cell = components_[component].cell;
+    uint16_t qcol = cell / N_QCORES_VERTICAL, qrow = cell % N_QCORES_VERTICAL;
+
+    uint8_t last_col_shift = (width_ - 1) * height_;
+
+    // the pixels of the neighbouring quarter core touching the component: the next column, the next row and the
+    // two diagonals towards the next column
+    uint16_t edge = (pixels >> last_col_shift) & first_col_;
+    uint16_t top = (pixels & last_row_) >> (height_ - 1);
+
+    struct
+    {
+        int8_t dcol, drow;
+        uint16_t pixels;
+    } neighbours[4] = {
+        {1, 0, uint16_t((edge | edge << 1 | edge >> 1) & first_col_)},
+        {0, 1, uint16_t((top | top << height_ | top >> height_) & first_row_)},
+        {1, 1, uint16_t(pixels >> (last_col_shift + height_ - 1) & 1)},
+        {1, -1, uint16_t((pixels >> last_col_shift & 1) << (height_ - 1))},
+    };
+
+    for (const auto &neighbour : neighbours)
+    {
+        int col = qcol + neighbour.dcol, row = qrow + neighbour.drow;
+
+        if (neighbour.pixels == 0 || col >= N_QCORES_HORIZONTAL || row < 0 || row >= N_QCORES_VERTICAL)
+            continue;
+
+        const Cell &other = cells_[col * N_QCORES_VERTICAL + row];
+
+        for (uint32_t i = other.first; i < other.first + other.count; i++)
+        {
+            if ((components_[i].pixels & neighbour.pixels) == 0)
+                continue;
+
+            uint32_t a = _find(component), b = _find(i);
+
+            // the earlier component stays root, so clusters come out in the order of their first quarter core
+            if (a != b)
+                components_[std::max(a, b)].parent = std::min(a, b);
+        }
+    }
+}
+
+size_t Clusterer::cluster(EventBatch::QcoreView qcores, std::vector<Cluster> &clusters, uint16_t event)
+{
+    size_t n_before = clusters.size();
+
+    try
+    {
+        for (const QuarterCore &qcore : qcores)
+            _add_components(qcore, event);
+    }
+    catch (...)
+    {
+        for (uint32_t cell : touched_)
+            cells_[cell] = {NO_COMPONENT, 0};
+
+        touched_.clear();
+        components_.clear();
+        throw;
+    }
+
+    for (uint32_t component = 0; component < components_.size(); component++)
+        _join_neighbours(component);
+
+    for (uint32_t component = 0; component < components_.size(); component++)
+    {
+        Component &root = components_[_find(component)];
+
+        if (root.cluster == NO_COMPONENT)
+        {
+            root.cluster = clusters.size();
+            clusters.push_back(components_[component].summary);
+            continue;
+        }
+
+        const Cluster &part = components_[component].summary;
+        Cluster &whole = clusters[root.cluster];
+
+        whole.col_min = std::min(whole.col_min, part.col_min);
+        whole.col_max = std::max(whole.col_max, part.col_max);
+        whole.row_min = std::min(whole.row_min, part.row_min);
+        whole.row_max = std::max(whole.row_max, part.row_max);
+        whole.size += part.size;
+        whole.tot += part.tot;
+    }
+
+    for (uint32_t cell : touched_)
+        cells_[cell] = {NO_COMPONENT, 0};
+
+    touched_.clear();
+    components_.clear();
+
+    return clusters.size() - n_before;
+}
+
+size_t Clusterer::cluster(const EventBatch &batch, std::vector<Cluster> &clusters)
+{
+    const StreamConfig &config = batch.get_config();
+
+    if (config.size_qcore_horizontal != config_.size_qcore_horizontal || config.size_qcore_vertical != config_.size_qcore_vertical)
+        throw std::invalid_argument("Cannot cluster quarter cores of another size");
+
+    size_t n_clusters = 0;
+
+    for (size_t trigger = 0; trigger < batch.n_triggers(); trigger++)
+        n_clusters += cluster(batch.get_qcores(trigger), clusters, trigger);
+
+    return n_clusters;
+}
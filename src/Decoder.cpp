@@ -1,4 +1,6 @@
 #include "RD53Event.h"
+#include "BinaryTree.h"
+#include "Tots.h"
 
 #include <cstdint>
 #include <stdexcept>
@@ -10,124 +12,211 @@
 
 using namespace RD53;
 
-constexpr auto BITS_PER_WORD = std::numeric_limits<word_t>::digits;
-
-/**
- * @brief Decodes a compressed bit pair from the input bits.
- *
- * @param bits The input bits.
- * @return A pair containing the decoded value and the number of bits read.
- */
-inline std::pair<uint8_t, uint8_t> decode_bitpair(uint8_t bits)
+Decoder::Decoder(const StreamConfig &config, StreamView stream, std::pmr::memory_resource *resource) : state_(DataTags::TRIGGER_TAG), decode_(nullptr), reader_(), owned_(), stream_(stream), config_(config), batch_(config, resource), current_header_(nullptr), hits_(nullptr), hit_buffer_(nullptr), first_frame_(0), pixel_of_(&qcore_layout::PIXEL_OF[config.size_qcore_horizontal == 8]), occupancy_(nullptr), n_counted_(0), qc_()
 {
-    bits &= 0b11;
-
-    if (((bits >> 1) & 0b1) == 0)
-        return {1, 1};
+}
 
-    return {bits, 2};
+Decoder::Decoder(const StreamConfig &config, const word_t *words, size_t n_words) : Decoder(config, StreamView(words, n_words))
+{
 }
 
-DataTags state;
+Decoder::Decoder(const StreamConfig &config, const std::vector<word_t> &words) : Decoder(config, StreamView(words))
+{
+}
 
-Decoder::Decoder(const StreamConfig &config, std::vector<word_t> &words) : stream_(words), config_(config), bit_index_(0), jump_size_(0), qc_(), events_(), current_event_(), current_header_(), current_qcores_()
+Decoder::Decoder(const StreamConfig &config, std::vector<word_t> &&words) : Decoder(config, StreamView())
 {
-    // for (auto word : stream_)
-    // {
-    //     std::cout << std::bitset<64>(word) << std::endl;
-    // }
+    owned_ = std::move(words);
+    stream_ = StreamView(owned_);
 }
 
 inline void Decoder::_new_event()
 {
-    events_.push_back({StreamHeader(), std::vector<QuarterCore>(0, QuarterCore(config_))});
-
-    current_event_ = events_.begin() + events_.size() - 1;
+    batch_.add_trigger();
 
-    current_header_ = &current_event_->first;
-    current_qcores_ = &current_event_->second;
+    current_header_ = &batch_.headers_.back();
 
     qc_ = QuarterCore(config_);
 }
 
 void Decoder::process_stream()
 {
-    _new_event();
+    if (stream_.empty())
+        throw std::invalid_argument("Cannot decode an empty stream");
+
+    _start();
+
+    _validate_chip_id();
+
+    _decode(std::numeric_limits<size_t>::max());
+}
+
+size_t Decoder::decode_hits(std::vector<PixelHit> &hits)
+{
+    if (stream_.empty())
+        throw std::invalid_argument("Cannot decode an empty stream");
+
+    size_t n_hits = hits.size();
+
+    _start();
+
+    _validate_chip_id();
 
-    bit_index_ = 0;
+    hits_ = &hits;
+    decode_ = _select_decoder<Output::HITS>();
 
-    word_size_ = config_.chip_id ? 61 : 63;
-    word_meta_size_ = config_.chip_id ? 3 : 1;
+    _decode(std::numeric_limits<size_t>::max());
+
+    hits_ = nullptr;
+
+    return hits.size() - n_hits;
+}
+
+size_t Decoder::decode_hits(HitBuffer &hits)
+{
+    if (stream_.empty())
+        throw std::invalid_argument("Cannot decode an empty stream");
+
+    size_t n_hits = hits.size();
+
+    _start();
 
     _validate_chip_id();
-    _get_trigger_tag();
+
+    hit_buffer_ = &hits;
+    first_frame_ = hits.n_frames();
+    decode_ = _select_decoder<Output::HIT_BUFFER>();
+
+    _decode(std::numeric_limits<size_t>::max());
+
+    // triggers without hits still get their frame
+    while (hits.n_frames() < first_frame_ + batch_.n_triggers())
+        hits.add_frame();
+
+    hit_buffer_ = nullptr;
+
+    return hits.size() - n_hits;
 }
 
-word_t Decoder::_shift_stream(size_t bit_index)
+size_t Decoder::decode_occupancy(std::vector<uint32_t> &occupancy)
 {
+    if (stream_.empty())
+        throw std::invalid_argument("Cannot decode an empty stream");
 
-    size_t word_index = bit_index / word_size_;
-    size_t bit_offset = bit_index % word_size_;
+    const size_t n_pixels = N_QCORES_HORIZONTAL * config_.size_qcore_horizontal * N_QCORES_VERTICAL * config_.size_qcore_vertical;
 
-    uint16_t remaining_words = stream_.size() - word_index;
+    if (occupancy.empty())
+        occupancy.resize(n_pixels);
+    else if (occupancy.size() != n_pixels)
+        throw std::invalid_argument("Occupancy has " + std::to_string(occupancy.size()) + " counters for " + std::to_string(n_pixels) + " pixels");
 
-    // std::cout << "word_index: " << word_index << " bit_offset: " << bit_offset << " remaining_words: " << remaining_words << std::endl;
+    _start();
 
-    word_t first_word = remaining_words == 0 ? 0 : (stream_[word_index] << word_meta_size_) >> word_meta_size_;
-    word_t second_word = remaining_words == 1 ? 0 : (stream_[word_index + 1] << word_meta_size_);
+    _validate_chip_id();
 
-    first_word = bit_offset == 0 ? first_word : (first_word << bit_offset);
-    second_word = bit_offset == 0 ? 0 : (second_word >> (BITS_PER_WORD - bit_offset));
+    occupancy_ = occupancy.data();
+    n_counted_ = 0;
+    decode_ = _select_decoder<Output::OCCUPANCY>();
 
-    word_t full_word = first_word | second_word;
+    _decode(std::numeric_limits<size_t>::max());
 
-    if (debug)
-    {
-        std::string word_str = std::bitset<64>(full_word).to_string().erase(0, word_meta_size_);
-        std::string first_word_str(word_str, 0, word_size_ - bit_offset);
-        std::string second_word_str(word_str, word_size_ - bit_offset, word_size_);
+    occupancy_ = nullptr;
 
-        std::stringstream ss;
+    return n_counted_;
+}
 
-        ss << fgc[Color::CYAN] << first_word_str << fgc[Color::GREEN] << second_word_str << fgc[Color::RESET] << "  " << jump_size_ << " " << bit_index << " " << state;
+void Decoder::_start()
+{
+    batch_.clear();
 
-        auto str = ss.str();
+    _new_event();
 
-        if (jump_size_ > 0)
-        {
-            const auto first_bracket = std::string(bgc[Color::BRIGHT_YELLOW]);
-            const auto second_bracket = std::string(bgc[Color::RESET]);
+    reader_ = BitReader(stream_.data, stream_.size, config_.chip_id ? 3 : 1);
 
-            str.insert(0, first_bracket);
+    state_ = DataTags::TRIGGER_TAG;
 
-            uint16_t overlap_increment = word_size_ - bit_offset < jump_size_ ? fgc[Color::GREEN].size() : 0;
+    decode_ = _select_decoder<Output::QCORES>();
+}
 
-            str.insert(jump_size_ + fgc[Color::CYAN].size() + first_bracket.size() + overlap_increment, second_bracket);
+void Decoder::_rebind(StreamView stream, size_t dropped)
+{
+    size_t position = reader_.position() - dropped * reader_.payload_bits();
+
+    stream_ = stream;
+
+    reader_ = BitReader(stream_.data, stream_.size, config_.chip_id ? 3 : 1);
+    reader_.seek(position);
+}
+
+template <typename F>
+bool Decoder::_decode_as(size_t limit)
+{
+    // only decode a field while it is guaranteed to end before the limit, every field is at most MAX_STEP_BITS wide
+    while (reader_.position() + MAX_STEP_BITS <= limit)
+    {
+        // flat state machine, every handler decodes a single field and returns the next state
+        switch (state_)
+        {
+        case DataTags::TRIGGER_TAG:
+            state_ = _get_trigger_tag<F>();
+            break;
+        case DataTags::EXTRA_IDS:
+            state_ = _get_trigger_ids<F>();
+            break;
+        case DataTags::COLUMN:
+            state_ = _get_col<F>();
+            break;
+        case DataTags::IS_LAST:
+            if constexpr (F::output == Output::OCCUPANCY)
+                state_ = _count_column<F>();
+            else
+                state_ = _get_neighbour_and_last<F>();
+            break;
+        case DataTags::ROW:
+            state_ = _get_row<F>();
+            break;
+        case DataTags::HITMAP:
+            state_ = _get_hitmap<F>();
+            break;
+        case DataTags::TOT:
+            state_ = _get_tots<F>();
+            break;
+        case DataTags::END_OF_STREAM:
+            return false;
+        default:
+            throw std::logic_error("Decoder reached an invalid state");
         }
 
-        std::cout << str << std::endl;
+        // past the end the stream reads as zeros, which only ends the stream through a zero column
+        if (reader_.position() > reader_.size() + MAX_STEP_BITS)
+            throw std::runtime_error("Stream ended before its end of stream marker");
     }
 
-    return full_word;
+    return state_ != DataTags::END_OF_STREAM;
 }
 
-word_t Decoder::_get_nbits(uint8_t n_bits, bool increment)
+template <typename F>
+word_t Decoder::_get_nbits(uint8_t n_bits)
 {
-    if (increment)
-        jump_size_ = n_bits;
-    else
-        jump_size_ = 0;
+    word_t value = reader_.read(n_bits);
 
-    word_t a = _shift_stream(bit_index_);
+    if constexpr (F::debug)
+        _print_field(value, n_bits);
 
-    if (increment)
-        bit_index_ += n_bits;
+    return value;
+}
 
-    return (a >> (word_size_ - n_bits)) & ((1 << n_bits) - 1);
+void Decoder::_print_field(word_t value, uint8_t n_bits) const
+{
+    std::cout << set_color(data_tag_colors.at(state_)) << get_lsb_binary(value, n_bits) << fgc.at(Color::RESET) << bgc.at(Color::RESET)
+              << "  " << static_cast<uint32_t>(n_bits) << " " << reader_.position() << " " << state_ << std::endl;
 }
 
 void Decoder::_validate_chip_id()
 {
+    // without chip ID the bits are part of the payload
+    if (!config_.chip_id)
+        return;
 
     uint8_t chip_id = stream_[0] >> 61 & 0b11;
 
@@ -140,263 +229,370 @@ void Decoder::_validate_chip_id()
     current_header_->chip_id = chip_id;
 }
 
-void Decoder::_get_trigger_tag()
+template <typename F>
+DataTags Decoder::_get_trigger_tag()
 {
-    state = DataTags::TRIGGER_TAG;
-
-    uint8_t tag = _get_nbits(data_widths::TRIGGER_TAG_WIDTH);
+    uint8_t tag = _get_nbits<F>(data_widths::TRIGGER_TAG_WIDTH);
 
     current_header_->trigger_tag = tag >> 2;
     current_header_->trigger_pos = tag & 0b11;
 
-    if (debug)
+    if constexpr (F::debug)
         std::cout << "Trigger tag: " << static_cast<uint32_t>(current_header_->trigger_tag) << ", pos: " << static_cast<uint32_t>(current_header_->trigger_pos) << std::endl;
 
-    if ((config_.l1id || config_.bcid) && current_event_ == events_.begin())
-        _get_trigger_ids();
+    if ((config_.l1id || config_.bcid) && batch_.n_triggers() == 1)
+        return DataTags::EXTRA_IDS;
 
-    _get_col();
+    return DataTags::COLUMN;
 }
 
-void Decoder::_get_trigger_ids()
+template <typename F>
+DataTags Decoder::_get_trigger_ids()
 {
-    state = DataTags::EXTRA_IDS;
+    _set_trigger_ids(config_, *current_header_, _get_nbits<F>(16));
 
-    uint16_t ids = _get_nbits(16);
+    if constexpr (F::debug)
+        std::cout << "ids: " << current_header_->bcid << " " << current_header_->l1id << std::endl;
 
-    switch (config_.l1id << 1 | config_.bcid)
+    return DataTags::COLUMN;
+}
+
+void Decoder::_set_trigger_ids(const StreamConfig &config, StreamHeader &header, uint16_t ids)
+{
+    switch (config.l1id << 1 | config.bcid)
     {
     case 0b01:
-        current_header_->bcid = ids;
+        header.bcid = ids;
         break;
     case 0b10:
-        current_header_->l1id = ids;
+        header.l1id = ids;
         break;
     case 0b11:
-        current_header_->bcid = ids & 0xFF;
-        current_header_->l1id = (ids >> 8) & 0xFF;
+        header.bcid = ids & 0xFF;
+        header.l1id = (ids >> 8) & 0xFF;
         break;
     default:
         break;
     }
-
-    if (debug)
-        std::cout << "ids: " << current_header_->bcid << " " << current_header_->l1id << std::endl;
 }
 
-void Decoder::_get_col()
+StreamHeader Decoder::peek_header(const StreamConfig &config, StreamView stream)
 {
-    state = DataTags::COLUMN;
+    if (stream.empty())
+        throw std::invalid_argument("Cannot read the header of an empty stream");
 
-    uint8_t col = _get_nbits(data_widths::COL_WIDTH);
+    BitReader reader(stream.data, stream.size, config.chip_id ? 3 : 1);
+    StreamHeader header;
 
-    if (debug)
+    if (config.chip_id)
+        header.chip_id = stream[0] >> 61 & 0b11;
+
+    uint8_t tag = reader.read(data_widths::TRIGGER_TAG_WIDTH);
+
+    header.trigger_tag = tag >> 2;
+    header.trigger_pos = tag & 0b11;
+
+    if (config.l1id || config.bcid)
+        _set_trigger_ids(config, header, reader.read(16));
+
+    return header;
+}
+
+template <typename F>
+DataTags Decoder::_get_col()
+{
+    uint8_t col = reader_.peek(data_widths::COL_WIDTH);
+
+    if constexpr (F::debug)
         std::cout << "col: " << static_cast<uint32_t>(col) << std::endl;
 
-    if (col == 0)
+    if (col != 0 && col < 56)
     {
-        if (current_qcores_->empty())
-        {
-            current_qcores_->push_back(QuarterCore());
-        }
-        current_qcores_->back().set_is_last(true);
-        current_qcores_->back().set_is_last_in_event(true);
+        _get_nbits<F>(data_widths::COL_WIDTH);
+        qc_.set_col(col - 1);
 
-        return;
+        return DataTags::IS_LAST;
     }
-    else if (col >= 56)
-    {
-        if (current_qcores_->empty())
-        {
-            current_qcores_->push_back(QuarterCore());
-        }
-        current_qcores_->back().set_is_last(true);
-        current_qcores_->back().set_is_last_in_event(true);
 
-        _new_event();
-        _get_nbits(3);
-
-        _get_trigger_tag();
-    }
-    else
+    if constexpr (F::output == Output::QCORES)
     {
-        qc_.set_col(col - 1);
+        // an empty trigger is stored as a single quarter core without hits
+        if (batch_.offsets_.back() == batch_.offsets_[batch_.n_triggers() - 1])
+            batch_.push_qcore(QuarterCore(config_));
 
-        _get_neighbour_and_last();
+        batch_.qcores_.back().set_is_last(true);
+        batch_.qcores_.back().set_is_last_in_event(true);
     }
+
+    if (col == 0)
+        return DataTags::END_OF_STREAM;
+
+    // a new trigger is marked by 0b111 followed by the 8 bit tag
+    _get_nbits<F>(3);
+    _new_event();
+
+    return DataTags::TRIGGER_TAG;
 }
 
-void Decoder::_get_neighbour_and_last()
+template <typename F>
+DataTags Decoder::_get_neighbour_and_last()
 {
-    state = DataTags::IS_LAST;
-
-    qc_.set_is_last(_get_nbits(1));
+    qc_.set_is_last(_get_nbits<F>(1));
 
-    state = DataTags::IS_NEIGHBOUR;
+    state_ = DataTags::IS_NEIGHBOUR;
 
-    qc_.set_is_neighbour(_get_nbits(1));
+    qc_.set_is_neighbour(_get_nbits<F>(1));
 
-    if (debug)
+    if constexpr (F::debug)
         std::cout << "is_neighbour: " << static_cast<uint32_t>(qc_.get_is_neighbour()) << " is_last: " << static_cast<uint32_t>(qc_.get_is_last()) << std::endl;
 
-    if (qc_.get_is_neighbour())
-    {
-        qc_.set_row(qc_.get_row() + 1);
+    if (!qc_.get_is_neighbour())
+        return DataTags::ROW;
 
-        if (debug)
-            std::cout << "row: " << static_cast<uint32_t>(qc_.get_row()) << std::endl;
+    qc_.set_row(qc_.get_row() + 1);
 
-        _get_hitmap();
-    }
-    else
-        _get_row();
+    if constexpr (F::debug)
+        std::cout << "row: " << static_cast<uint32_t>(qc_.get_row()) << std::endl;
+
+    return DataTags::HITMAP;
 }
 
-void Decoder::_get_row()
+template <typename F>
+DataTags Decoder::_get_row()
 {
-    state = DataTags::ROW;
-
-    uint8_t row = _get_nbits(data_widths::ROW_WIDTH);
+    uint8_t row = _get_nbits<F>(data_widths::ROW_WIDTH);
 
-    if (debug)
+    if constexpr (F::debug)
         std::cout << "row: " << static_cast<uint32_t>(row) << std::endl;
 
     qc_.set_row(row);
 
-    _get_hitmap();
+    return DataTags::HITMAP;
 }
 
-void Decoder::_get_hitmap()
+template <typename F>
+DataTags Decoder::_get_hitmap()
 {
-
     uint16_t hit_raw = 0;
-    uint64_t tots_raw = 0;
 
-    if (config_.compressed_hitmap)
+    if constexpr (F::compressed_hitmap)
     {
+        word_t code = F::debug ? reader_.peek(binary_tree::MAX_LENGTH) : 0;
+        size_t start = reader_.position();
 
-        state = DataTags::S1;
-        auto [s1, read_bits] = decode_bitpair(_get_nbits(2, false));
+        hit_raw = binary_tree::decode(reader_);
 
-        if (debug)
-            std::cout << std::bitset<2>(s1) << std::endl;
+        if constexpr (F::debug)
+        {
+            uint8_t length = reader_.position() - start;
+            _print_field(code >> (binary_tree::MAX_LENGTH - length), length);
+        }
+    }
+    else
+    {
+        hit_raw = _get_nbits<F>(data_widths::HITMAP_WIDTH);
+    }
 
-        bit_index_ += read_bits;
+    qc_.set_hit_raw(hit_raw, 0);
 
-        for (int i = 0; i < 2; ++i)
-        {
-            if ((s1 & (2 >> i)) == 0)
-                continue;
+    if constexpr (!F::drop_tot)
+        return DataTags::TOT;
+    else if constexpr (F::hits)
+        return _push_hits<F>(hit_raw, 0);
+    else
+        return _push_qcore<F>();
+}
 
-            state = DataTags::S2;
-            auto [s2, read_bits] = decode_bitpair(_get_nbits(2, false));
+template <typename F>
+DataTags Decoder::_get_tots()
+{
+    uint16_t hit_raw = qc_.get_hit_raw().first;
 
-            if (debug)
-                std::cout << std::bitset<2>(s2) << std::endl;
+    // the ToTs of all hits form one block in the stream, which is read at once and scattered into the nibbles
+    uint64_t packed = _get_nbits<F>(data_widths::TOT_WIDTH * tots::count(hit_raw));
 
-            bit_index_ += read_bits;
+    if constexpr (F::hits)
+        return _push_hits<F>(hit_raw, packed);
 
-            std::array<uint8_t, 2> ss3 = {0, 0};
+    qc_.set_hit_raw(hit_raw, tots::expand(hit_raw, packed));
 
-            size_t total = __builtin_popcount(s2);
+    return _push_qcore<F>();
+}
+
+template <typename F>
+DataTags Decoder::_push_qcore()
+{
+    if constexpr (F::debug)
+    {
+        auto [hit_raw, tots_raw] = qc_.get_hit_raw();
+        std::cout << "HITS_RAW: " << std::bitset<16>(hit_raw) << " TOTS_RAW: " << std::hex << std::setw(16) << std::setfill('0') << tots_raw << std::dec << std::endl;
+    }
 
-            for (size_t j = 0; j < total; j++)
-            {
+    batch_.push_qcore(qc_);
 
-                state = DataTags::S3;
-                auto [s3, read_bits] = decode_bitpair(_get_nbits(2, false));
+    // reset hits
+    qc_.set_hit_raw(0, 0);
 
-                if (debug)
-                    std::cout << std::bitset<2>(s3) << std::endl;
+    return qc_.get_is_last() ? DataTags::COLUMN : DataTags::IS_LAST;
+}
 
-                bit_index_ += read_bits;
+template <typename F>
+DataTags Decoder::_count_column()
+{
+    const size_t height = N_QCORES_VERTICAL * config_.size_qcore_vertical;
 
-                ss3[j] = s3;
-            }
+    uint32_t *column = occupancy_ + qc_.get_col() * config_.size_qcore_horizontal * height;
+    uint8_t row = qc_.get_row();
+    bool is_last;
 
-            uint8_t current_s3 = 0;
+    // the whole run of quarter cores of the column is decoded in one go, as only the counters depend on it
+    do
+    {
+        constexpr uint8_t FLAGS_WIDTH = data_widths::IS_LAST_WIDTH + data_widths::IS_NEIGHBOUR_WIDTH;
+        constexpr uint8_t HEADER_WIDTH = FLAGS_WIDTH + data_widths::ROW_WIDTH;
+        constexpr uint8_t KEY_WIDTH = F::compressed_hitmap ? binary_tree::LUT_BITS : data_widths::HITMAP_WIDTH;
 
-            for (size_t j = 0; j < 2; j++)
-            {
-                if ((s2 & (2 >> j)) == 0)
-                    continue;
+        // the flags, the row and the hitmap (or its table key) at once, a neighbour has no row field
+        word_t window = reader_.peek(HEADER_WIDTH + KEY_WIDTH);
 
-                for (size_t k = 0; k < 2; k++)
-                {
-                    if ((ss3[current_s3] & (2 >> k)) == 0)
-                        continue;
+        is_last = window >> (HEADER_WIDTH + KEY_WIDTH - 1);
+        bool is_neighbour = window >> (HEADER_WIDTH + KEY_WIDTH - 2) & 1;
 
-                    state = DataTags::HITPAIR;
-                    auto [hitpair, read_bits] = decode_bitpair(_get_nbits(2, false));
+        uint8_t header_width = is_neighbour ? FLAGS_WIDTH : HEADER_WIDTH;
+        uint8_t next_row = window >> KEY_WIDTH;
 
-                    if (debug)
-                        std::cout << std::bitset<2>(hitpair) << std::endl;
+        row = is_neighbour ? row + 1 : next_row;
 
-                    hit_raw |= (((hitpair & 0b01) << 1) | ((hitpair & 0b10) >> 1)) << (j * 4 + k * 2 + i * 8);
+        uint16_t key = (window >> (HEADER_WIDTH - header_width)) & ((1u << KEY_WIDTH) - 1);
+        uint16_t hit_raw = key;
+        uint8_t hitmap_width = KEY_WIDTH;
 
-                    bit_index_ += read_bits;
-                }
+        if constexpr (F::compressed_hitmap)
+        {
+            const binary_tree::LutEntry &entry = binary_tree::decode_table[key];
 
-                current_s3++;
-            }
+            hit_raw = entry.hit_raw;
+            hitmap_width = entry.length;
         }
-    }
-    else
-    {
-        state = DataTags::HITMAP;
 
-        hit_raw = _get_nbits(data_widths::HITMAP_WIDTH);
-    }
+        if (hitmap_width == 0)
+        {
+            // longer than the table key, decode the hitmap bit by bit
+            reader_.skip(header_width);
+            hit_raw = binary_tree::decode_slow(reader_);
+            header_width = 0;
+        }
 
-    if (!config_.drop_tot)
-        tots_raw = _get_tots(hit_raw);
+        // the ToTs are not needed, jump over them together with the fields already decoded
+        reader_.skip(header_width + hitmap_width + (F::drop_tot ? 0 : data_widths::TOT_WIDTH * tots::count(hit_raw)));
 
-    qc_.set_hit_raw(hit_raw, tots_raw);
+        if constexpr (F::debug)
+            std::cout << "col: " << static_cast<uint32_t>(qc_.get_col()) << " row: " << static_cast<uint32_t>(row) << " HITS_RAW: " << std::bitset<16>(hit_raw) << std::endl;
 
-    if (debug)
-        std::cout << "HITS_RAW: " << std::bitset<16>(hit_raw) << " TOTS_RAW: " << std::hex << std::setw(16) << std::setfill('0') << tots_raw << std::endl;
+        if (row >= N_QCORES_VERTICAL)
+            throw std::runtime_error("ERROR: row index " + std::to_string(row) + " out of range");
 
-    current_qcores_->push_back(qc_);
+        if (reader_.position() > reader_.size() + MAX_STEP_BITS)
+            throw std::runtime_error("Stream ended before its end of stream marker");
 
-    // reset hits
-    qc_.set_hit_raw(0, 0);
+        uint32_t *counters = column + row * config_.size_qcore_vertical;
 
-    if (qc_.get_is_last())
-        _get_col();
-    else
-        _get_neighbour_and_last();
-}
+        n_counted_ += tots::count(hit_raw);
 
-uint64_t Decoder::_get_tots(uint16_t hit_raw)
-{
-    state = DataTags::TOT;
+        for (; hit_raw != 0; hit_raw &= hit_raw - 1)
+        {
+            auto [offset_col, offset_row] = (*pixel_of_)[__builtin_ctz(hit_raw)];
 
-    uint8_t hit_index = 15;
-    uint8_t hit_counter = 0;
+            counters[offset_col * height + offset_row]++;
+        }
+    } while (!is_last);
 
-    uint8_t n_hits = __builtin_popcount(hit_raw);
+    qc_.set_row(row);
 
-    uint64_t tots = 0;
+    return DataTags::COLUMN;
+}
+
+template <typename F>
+DataTags Decoder::_push_hits(uint16_t hit_raw, uint64_t packed)
+{
+    if constexpr (F::debug)
+        std::cout << "HITS_RAW: " << std::bitset<16>(hit_raw) << " TOTS: " << std::hex << packed << std::dec << std::endl;
 
-    while (hit_counter < n_hits)
+    uint16_t col = qc_.get_col() * config_.size_qcore_horizontal;
+    uint16_t row = qc_.get_row() * config_.size_qcore_vertical;
+    uint16_t event = batch_.n_triggers() - 1;
+
+    if constexpr (F::output == Output::HIT_BUFFER)
     {
-        uint8_t hit = (hit_raw & (1 << hit_index)) >> hit_index;
+        // open the frames of the triggers since the last hit
+        while (hit_buffer_->n_frames() <= first_frame_ + event)
+            hit_buffer_->add_frame();
 
-        if (hit)
+        for (; hit_raw != 0; hit_raw &= hit_raw - 1, packed >>= data_widths::TOT_WIDTH)
         {
-            hit_counter++;
-
-            uint64_t tot_value = _get_nbits(data_widths::TOT_WIDTH);
+            auto [offset_col, offset_row] = (*pixel_of_)[__builtin_ctz(hit_raw)];
 
-            tots |= tot_value << (hit_index * 4);
+            hit_buffer_->push_back(col + offset_col, row + offset_row, packed & 0xF);
         }
-        hit_index--;
+
+        return qc_.get_is_last() ? DataTags::COLUMN : DataTags::IS_LAST;
     }
 
-    return tots;
+    size_t n_hits = hits_->size();
+    hits_->resize(n_hits + tots::count(hit_raw));
+
+    PixelHit *hit = hits_->data() + n_hits;
+
+    // the hits are visited from the lowest index up, which is the order of the ToT nibbles
+    for (; hit_raw != 0; hit_raw &= hit_raw - 1, packed >>= data_widths::TOT_WIDTH, hit++)
+    {
+        auto [offset_col, offset_row] = (*pixel_of_)[__builtin_ctz(hit_raw)];
+
+        *hit = {uint16_t(col + offset_col), uint16_t(row + offset_row), uint8_t(packed & 0xF), event};
+    }
+
+    return qc_.get_is_last() ? DataTags::COLUMN : DataTags::IS_LAST;
+}
+
+template <Decoder::Output O>
+Decoder::DecodeFn Decoder::_select_decoder() const
+{
+    // indexed by compressed_hitmap, drop_tot and debug
+    static constexpr DecodeFn decoders[] = {
+        &Decoder::_decode_as<Flags<false, false, false, O>>,
+        &Decoder::_decode_as<Flags<false, false, true, O>>,
+        &Decoder::_decode_as<Flags<false, true, false, O>>,
+        &Decoder::_decode_as<Flags<false, true, true, O>>,
+        &Decoder::_decode_as<Flags<true, false, false, O>>,
+        &Decoder::_decode_as<Flags<true, false, true, O>>,
+        &Decoder::_decode_as<Flags<true, true, false, O>>,
+        &Decoder::_decode_as<Flags<true, true, true, O>>,
+    };
+
+    return decoders[config_.compressed_hitmap << 2 | config_.drop_tot << 1 | debug];
 }
 
 Event Decoder::get_event() const
 {
-    return Event(config_, events_);
+    return Event(batch_);
+}
+
+Event Decoder::take_event()
+{
+    Event event(batch_);
+
+    batch_.clear();
+    current_header_ = nullptr;
+
+    return event;
+}
+
+EventBatch Decoder::take_batch()
+{
+    EventBatch batch(config_, batch_.qcores_.get_allocator().resource());
+
+    std::swap(batch, batch_);
+    current_header_ = nullptr;
+
+    return batch;
 }
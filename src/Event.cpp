@@ -5,15 +5,126 @@
 
 using namespace RD53;
 
-Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std::vector<HitCoord> &hits_)
-    : config(config_), header(header_), hits(hits_)
+namespace
 {
+    /**
+     * @brief The quarter cores of a chip as a dense grid, which buckets the hits of an event in linear time
+     *
+     * A cell holds the hitmap and ToTs of one quarter core. A bitmap per column and a mask of the occupied columns
+     * let the walk visit only the occupied cells, in encoding order, and clear them on the way.
+     */
+    class QcoreGrid
+    {
+    public:
+        /**
+         * @brief Adds a hit to a quarter core
+         *
+         * @return Whether the quarter core had no hits yet
+         */
+        bool set_hit(uint16_t qcol, uint16_t qrow, uint8_t index, uint8_t tot)
+        {
+            size_t cell = qcol * N_QCORES_VERTICAL + qrow;
+            uint64_t &rows = occupied_[qcol * WORDS_PER_COL + qrow / 64];
+            uint64_t bit = uint64_t(1) << (qrow % 64);
+
+            bool first = (rows & bit) == 0;
+
+            rows |= bit;
+            cols_ |= uint64_t(1) << qcol;
+
+            hits_[cell] |= 1 << index;
+            tots_[cell] = (tots_[cell] & ~((uint64_t)0xF << (index * 4))) | ((uint64_t)tot << (index * 4));
+
+            return first;
+        }
+
+        /**
+         * @brief Visits the occupied quarter cores in encoding order and clears the grid
+         *
+         * @param visit Called with the column, row, hitmap, ToTs, is_neighbour and is_last of every quarter core
+         */
+        template <typename F>
+        void walk(F &&visit)
+        {
+            while (cols_ != 0)
+            {
+                uint8_t qcol = 63 - __builtin_clzll(cols_);
+                cols_ ^= uint64_t(1) << qcol;
+
+                int prev_row = -2;
+
+                for (int word = 0; word < WORDS_PER_COL; word++)
+                {
+                    uint64_t &rows = occupied_[qcol * WORDS_PER_COL + word];
+
+                    while (rows != 0)
+                    {
+                        uint8_t qrow = word * 64 + __builtin_ctzll(rows);
+                        rows &= rows - 1;
+
+                        bool is_last = rows == 0 && _column_done(qcol, word);
+
+                        size_t cell = qcol * N_QCORES_VERTICAL + qrow;
+
+                        visit(qcol, qrow, hits_[cell], tots_[cell], qrow == prev_row + 1, is_last);
+
+                        hits_[cell] = 0;
+                        tots_[cell] = 0;
+
+                        prev_row = qrow;
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief Clears the grid without visiting it
+         */
+        void clear()
+        {
+            walk([](uint8_t, uint8_t, uint16_t, uint64_t, bool, bool) {});
+        }
+
+    private:
+        /** @brief The number of 64-bit words of the bitmap of one column */
+        static constexpr int WORDS_PER_COL = (N_QCORES_VERTICAL + 63) / 64;
+
+        bool _column_done(uint8_t qcol, int word) const
+        {
+            for (word++; word < WORDS_PER_COL; word++)
+            {
+                if (occupied_[qcol * WORDS_PER_COL + word] != 0)
+                    return false;
+            }
+
+            return true;
+        }
+
+        /** @brief The hitmap of every quarter core, column major */
+        std::array<uint16_t, N_QCORES_HORIZONTAL * N_QCORES_VERTICAL> hits_{};
+
+        /** @brief The ToTs of every quarter core, column major */
+        std::array<uint64_t, N_QCORES_HORIZONTAL * N_QCORES_VERTICAL> tots_{};
+
+        /** @brief The occupied rows of every column */
+        std::array<uint64_t, N_QCORES_HORIZONTAL * WORDS_PER_COL> occupied_{};
+
+        /** @brief The occupied columns */
+        uint64_t cols_ = 0;
+    };
+
+    static_assert(N_QCORES_HORIZONTAL <= 64, "the occupied columns are kept in a 64-bit mask");
 }
 
-Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std::vector<QuarterCore> &qcores_)
-    : config(config_), header(header_), qcores(qcores_)
+Event::Event(const StreamConfig &config_, const StreamHeader &header_, std::vector<HitCoord> hits_)
+    : config(config_), header(header_), hits(std::move(hits_))
 {
-    // update address of config in qcores
+}
+
+Event::Event(const StreamConfig &config_, const StreamHeader &header_, std::vector<QuarterCore> qcores_)
+    : config(config_), header(header_), qcores(std::move(qcores_))
+{
+    // the quarter cores take the geometry and encoding of the event
     for (auto &qcore : qcores)
     {
         qcore.set_config(&config);
@@ -43,8 +154,13 @@ Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std
     }
 }
 
-Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std::vector<std::vector<QuarterCore>> &frames_) : config(config_), header(header_)
+Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std::vector<std::vector<QuarterCore>> &frames_) : config(config_), header(header_), qcores(frames_[0])
 {
+    for (auto &qcore : qcores)
+    {
+        qcore.set_config(&config);
+    }
+
     bool first = true;
 
     for (uint64_t i = 1; i < frames_.size(); i++)
@@ -65,42 +181,22 @@ Event::Event(const StreamConfig &config_, const StreamHeader &header_, const std
     }
 }
 
-Event::Event(const StreamConfig &config_, const std::vector<std::pair<StreamHeader, std::vector<QuarterCore>>> events_) : Event(config_, events_[0].first, events_[0].second)
+Event::Event(const StreamConfig &config_, const StreamHeader &header_, const HitBuffer &hits_)
+    : Event(config_, header_, hits_.n_frames() > 0 ? hits_.get_frames() : std::vector<std::vector<HitCoord>>(1))
 {
-    bool first = true;
-
-    for (auto it = events_.begin() + 1; it != events_.end(); it++)
-    {
-
-        auto [header_, event_] = *it;
-
-
-        events.push_back(Event(config_, header_, event_));
-    }
 }
 
-Event::Event(const Event &other) : config(other.config), header(other.header), hits(other.hits), qcores(other.qcores), events(other.events)
+Event::Event(const EventBatch &batch)
 {
-    for (auto &qcore : qcores)
-    {
-        qcore.set_config(&config);
-    }
-}
+    if (batch.n_triggers() == 0)
+        throw std::invalid_argument("Cannot build an event from a batch without triggers");
 
-Event Event::operator=(const Event &other)
-{
-    config = other.config;
-    header = other.header;
-    hits = other.hits;
-    qcores = other.qcores;
-    events = other.events;
+    *this = batch.get_event(0);
 
-    for (auto &qcore : qcores)
-    {
-        qcore.set_config(&config);
-    }
+    events.reserve(batch.n_triggers() - 1);
 
-    return *this;
+    for (size_t trigger = 1; trigger < batch.n_triggers(); trigger++)
+        events.push_back(batch.get_event(trigger));
 }
 
 void Event::_get_qcores_from_pixelframe()
@@ -110,56 +206,45 @@ void Event::_get_qcores_from_pixelframe()
     if (hits.empty())
         throw std::runtime_error("No hits in event");
 
-    std::map<std::pair<int, int>, QuarterCore> qcore_dict;
+    // reused by every event built on this thread, the walk below leaves it empty again
+    thread_local std::unique_ptr<QcoreGrid> grid = std::make_unique<QcoreGrid>();
 
-    for (const auto [x, y, tot] : hits)
-    {
+    // the probe rejects an unknown qcore size
+    QuarterCore probe(config);
+
+    // index in the hit map of every pixel of a quarter core
+    const uint8_t width = config.size_qcore_horizontal, height = config.size_qcore_vertical;
+    const std::array<uint8_t, 16> &index_of = qcore_layout::INDEX_OF[width == 8];
 
-        uint16_t col_in_qcore = x % config.size_qcore_horizontal;
-        uint16_t qcol = (x - col_in_qcore) / config.size_qcore_horizontal;
-        uint16_t row_in_qcore = y % config.size_qcore_vertical;
-        uint16_t qrow = (y - row_in_qcore) / config.size_qcore_vertical;
+    size_t n_qcores = 0;
+
+    for (const auto &[x, y, tot] : hits)
+    {
+        uint16_t qcol = x / width, qrow = y / height;
 
-        if (qcore_dict.find({-qcol, qrow}) == qcore_dict.end())
+        if (qcol >= N_QCORES_HORIZONTAL || qrow >= N_QCORES_VERTICAL)
         {
-            qcore_dict[{-qcol, qrow}] = QuarterCore(config, qcol, qrow);
+            grid->clear();
+            throw std::out_of_range("hit (" + std::to_string(x) + ", " + std::to_string(y) + ") is outside of the chip");
         }
 
-        qcore_dict[{-qcol, qrow}].set_hit(col_in_qcore, row_in_qcore, tot);
+        n_qcores += grid->set_hit(qcol, qrow, index_of[(x % width) * height + y % height], tot);
     }
 
-    // TODO reverse column order (columns decrements from 55 to 1)
+    qcores.reserve(n_qcores);
 
-    for (auto it = qcore_dict.begin(); it != qcore_dict.end(); ++it)
-    {
-        size_t key_id = std::distance(qcore_dict.begin(), it);
-        auto &[key, qcore] = *it;
+    // columns are encoded from the highest to the lowest, the quarter cores of a column from the lowest row up
+    grid->walk([this](uint8_t qcol, uint8_t qrow, uint16_t hit_raw, uint64_t tots, bool is_neighbour, bool is_last)
+               {
+        QuarterCore qcore(config, qcol, qrow);
 
-        if (it == std::prev(qcore_dict.end()))
-        {
-            qcore.set_is_last(true);
-            qcore.set_is_last_in_event(true);
-        }
-        else
-        {
-            qcore.set_is_last_in_event(false);
+        qcore.set_hit_raw(hit_raw, tots);
+        qcore.set_is_neighbour(is_neighbour);
+        qcore.set_is_last(is_last);
 
-            auto &next_key = std::next(it)->first;
-            qcore.set_is_last(key.first != next_key.first);
-        }
+        qcores.push_back(qcore); });
 
-        if (it == qcore_dict.begin())
-        {
-            qcore.set_is_neighbour(false);
-        }
-        else
-        {
-            auto &prev_key = std::prev(it)->first;
-            qcore.set_is_neighbour(key.first == prev_key.first && key.second == prev_key.second + 1);
-        }
-
-        qcores.push_back(qcore);
-    }
+    qcores.back().set_is_last_in_event(true);
 }
 
 void Event::_get_pixelframe_from_qcores()
@@ -183,115 +268,150 @@ void Event::_get_pixelframe_from_qcores()
     }
 }
 
+HitBuffer Event::get_hit_buffer()
+{
+    HitBuffer buffer;
+
+    // every trigger gets a frame, also when it has no hits
+    auto add_frame = [&buffer](Event &event)
+    {
+        if (event.hits.empty() && !event.qcores.empty())
+            event._get_pixelframe_from_qcores();
+
+        buffer.add_frame(event.hits);
+    };
+
+    add_frame(*this);
+
+    for (auto &event : events)
+        add_frame(event);
+
+    return buffer;
+}
+
 std::vector<word_t> Event::serialize_event()
 {
     if (qcores.empty() && !hits.empty())
         _get_qcores_from_pixelframe();
 
-    const uint8_t WORD_SIZE = config.chip_id ? 61 : 63;
-    std::vector<word_t> result;
-    word_t current_word = 0;
-    uint8_t current_size = 0;
-
-    std::vector<std::tuple<uint8_t, RD53::word_t, DataTags>> packets = _retrieve_qcore_data();
+    for (auto &event : events)
+    {
+        if (event.qcores.empty() && !event.hits.empty())
+            event._get_qcores_from_pixelframe();
+    }
 
-    packets.insert(packets.begin(), std::make_tuple(8, (header.trigger_tag << 2) | (header.trigger_pos & 0b11), DataTags::TRIGGER_TAG));
+    if (debug)
+        _print_fields();
 
-    for (auto event : events)
-    {
-        auto subeventpackets = event._retrieve_qcore_data();
-        subeventpackets.insert(subeventpackets.begin(), std::make_tuple(11, 0b111 << 8 | ((event.header.trigger_tag & 0x3F) << 2) | (event.header.trigger_pos & 0b11), DataTags::TRIGGER_TAG));
+    std::vector<word_t> result;
+    BitWriter writer(result, config.chip_id ? 3 : 1);
 
-        packets.insert(packets.end(), subeventpackets.begin(), subeventpackets.end());
-    }
+    // the fields are packed straight into the words, in stream order
+    writer.write((header.trigger_tag << 2) | (header.trigger_pos & 0b11), data_widths::TRIGGER_TAG_WIDTH);
 
     switch (config.l1id << 1 | config.bcid)
     {
     case 0b01:
-        packets.insert(packets.begin() + 1, std::make_tuple(16, header.bcid, DataTags::EXTRA_IDS));
+        writer.write(header.bcid, 16);
         break;
     case 0b10:
-        packets.insert(packets.begin() + 1, std::make_tuple(16, header.l1id, DataTags::EXTRA_IDS));
+        writer.write(header.l1id, 16);
         break;
     case 0b11:
-        packets.insert(packets.begin() + 1, std::make_tuple(16, ((header.bcid & 0xFF) << 8) | (header.l1id & 0xFF), DataTags::EXTRA_IDS));
+        writer.write(((header.bcid & 0xFF) << 8) | (header.l1id & 0xFF), 16);
         break;
     default:
         break;
     }
 
-    if (debug)
+    _write_qcores(writer);
+
+    for (const auto &event : events)
     {
-        size_t s = 0;
-        for (const auto &[width, word, name] : packets)
-        {
-            std::string bits = get_lsb_binary(word, width);
+        writer.write(0b111 << 8 | ((event.header.trigger_tag & 0x3F) << 2) | (event.header.trigger_pos & 0b11), 11);
 
-            s += width;
+        event._write_qcores(writer);
+    }
 
-            if (s >= WORD_SIZE)
-            {
-                std::cout << set_color(data_tag_colors[name]) << bits.substr(0, width - (s - WORD_SIZE)) << fgc[Color::RESET] << bgc[Color::RESET] << std::endl
-                          << set_color(data_tag_colors[name]) << bits.substr(width - (s - WORD_SIZE));
+    writer.flush();
 
-                s -= WORD_SIZE;
-            }
-            else
-            {
-                std::cout << set_color(data_tag_colors[name]) << bits;
-            }
+    if (config.chip_id)
+    {
+        for (auto &word : result)
+        {
+            word |= ((uint64_t)header.chip_id & 0b11) << 61;
         }
-        std::cout << fgc[Color::RESET] << bgc[Color::RESET] << std::endl;
     }
 
-    for (const auto &[width, word, name] : packets)
-    {
+    result[result.size() - 1] = result.back() | (1ull << 63);
+    return result;
+}
 
-        uint8_t space_left = WORD_SIZE - current_size;
+void Event::_write_qcores(BitWriter &writer) const
+{
+    bool prev_last_in_col = true;
 
-        if (width <= space_left)
-        {
-            current_word <<= width;
-            current_word |= word & ((1 << width) - 1);
-            current_size += width;
+    for (const auto &qcore : qcores)
+    {
+        qcore.serialize_qcore(writer, prev_last_in_col);
+        prev_last_in_col = qcore.get_is_last();
+    }
+}
 
-            if (current_size == WORD_SIZE)
-            {
-                result.push_back(current_word);
-                current_word = 0;
-                current_size = 0;
-            }
-        }
-        else
-        {
-            int bits_for_current_word = word >> (width - space_left);
-            current_word <<= space_left;
-            current_word |= bits_for_current_word & ((1 << space_left) - 1);
+void Event::_print_fields()
+{
+    const uint8_t WORD_SIZE = config.chip_id ? 61 : 63;
 
-            result.push_back(current_word);
+    std::vector<std::tuple<uint8_t, RD53::word_t, DataTags>> packets;
 
-            current_word = word & ((1 << (width - space_left)) - 1);
-            current_size = (width - space_left);
-        }
+    packets.push_back(std::make_tuple(8, (header.trigger_tag << 2) | (header.trigger_pos & 0b11), DataTags::TRIGGER_TAG));
+
+    switch (config.l1id << 1 | config.bcid)
+    {
+    case 0b01:
+        packets.push_back(std::make_tuple(16, header.bcid, DataTags::EXTRA_IDS));
+        break;
+    case 0b10:
+        packets.push_back(std::make_tuple(16, header.l1id, DataTags::EXTRA_IDS));
+        break;
+    case 0b11:
+        packets.push_back(std::make_tuple(16, ((header.bcid & 0xFF) << 8) | (header.l1id & 0xFF), DataTags::EXTRA_IDS));
+        break;
+    default:
+        break;
     }
 
-    if (current_size > 0)
+    auto qcore_packets = _retrieve_qcore_data();
+    packets.insert(packets.end(), qcore_packets.begin(), qcore_packets.end());
+
+    for (auto &event : events)
     {
-        int shift_amount = WORD_SIZE - current_size;
-        current_word <<= shift_amount;
-        result.push_back(current_word);
+        packets.push_back(std::make_tuple(11, 0b111 << 8 | ((event.header.trigger_tag & 0x3F) << 2) | (event.header.trigger_pos & 0b11), DataTags::TRIGGER_TAG));
+
+        auto subevent_packets = event._retrieve_qcore_data();
+        packets.insert(packets.end(), subevent_packets.begin(), subevent_packets.end());
     }
 
-    if (config.chip_id)
+    size_t s = 0;
+    for (const auto &[width, word, name] : packets)
     {
-        for (auto &word : result)
+        std::string bits = get_lsb_binary(word, width);
+
+        s += width;
+
+        if (s >= WORD_SIZE)
         {
-            word |= ((uint64_t)header.chip_id & 0b11) << 61;
+            std::cout << set_color(data_tag_colors.at(name)) << bits.substr(0, width - (s - WORD_SIZE)) << fgc.at(Color::RESET) << bgc.at(Color::RESET) << std::endl
+                      << set_color(data_tag_colors.at(name)) << bits.substr(width - (s - WORD_SIZE));
+
+            s -= WORD_SIZE;
+        }
+        else
+        {
+            std::cout << set_color(data_tag_colors.at(name)) << bits;
         }
     }
-
-    result[result.size() - 1] = result.back() | (1ull << 63);
-    return result;
+    std::cout << fgc.at(Color::RESET) << bgc.at(Color::RESET) << std::endl;
 }
 
 std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> Event::_retrieve_qcore_data()
@@ -0,0 +1,63 @@
+#include "RD53Event.h"
+#include "Tots.h"
+
+using namespace RD53;
+
+EventBatch::EventBatch(const StreamConfig &config, std::pmr::memory_resource *resource) : config_(config), headers_(resource), qcores_(resource), offsets_(1, 0, resource)
+{
+}
+
+HitBuffer EventBatch::get_hits() const
+{
+    HitBuffer hits;
+
+    if (qcores_.empty())
+    {
+        for (size_t trigger = 0; trigger < n_triggers(); trigger++)
+            hits.add_frame();
+
+        return hits;
+    }
+
+    // this also rejects an unknown qcore size
+    QuarterCore probe(config_);
+
+    const std::array<qcore_layout::Pixel, 16> &pixel_of = qcore_layout::PIXEL_OF[config_.size_qcore_horizontal == 8];
+
+    size_t n_hits = 0;
+
+    for (const auto &qcore : qcores_)
+        n_hits += tots::count(qcore.get_hit_raw().first);
+
+    hits.reserve(n_hits);
+
+    for (size_t trigger = 0; trigger < n_triggers(); trigger++)
+    {
+        hits.add_frame();
+
+        for (const auto &qcore : get_qcores(trigger))
+        {
+            auto [hit_raw, tots_raw] = qcore.get_hit_raw();
+
+            uint16_t col = qcore.get_col() * config_.size_qcore_horizontal;
+            uint16_t row = qcore.get_row() * config_.size_qcore_vertical;
+
+            for (; hit_raw != 0; hit_raw &= hit_raw - 1)
+            {
+                uint8_t index = __builtin_ctz(hit_raw);
+                auto [offset_col, offset_row] = pixel_of[index];
+
+                hits.push_back(col + offset_col, row + offset_row, tots_raw >> (index * 4) & 0xF);
+            }
+        }
+    }
+
+    return hits;
+}
+
+Event EventBatch::get_event(size_t trigger) const
+{
+    QcoreView qcores = get_qcores(trigger);
+
+    return Event(config_, headers_[trigger], std::vector<QuarterCore>(qcores.begin(), qcores.end()));
+}
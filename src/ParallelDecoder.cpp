@@ -0,0 +1,72 @@
+#include "RD53Event.h"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+using namespace RD53;
+
+ParallelDecoder::ParallelDecoder(const StreamConfig &config, unsigned n_threads) : config_(config), n_threads_(n_threads)
+{
+    if (n_threads_ == 0)
+        n_threads_ = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::vector<Event> ParallelDecoder::decode(const std::vector<StreamView> &streams) const
+{
+    std::vector<Event> events(streams.size());
+    std::vector<std::exception_ptr> errors(streams.size());
+
+    std::atomic<size_t> next_stream(0);
+
+    // workers pull the next stream from a shared counter, which balances streams of different lengths
+    auto worker = [&]()
+    {
+        for (size_t i = next_stream++; i < streams.size(); i = next_stream++)
+        {
+            try
+            {
+                Decoder decoder(config_, streams[i]);
+                decoder.process_stream();
+                events[i] = decoder.get_event();
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    size_t n_workers = std::min<size_t>(n_threads_, streams.size());
+
+    std::vector<std::thread> threads;
+
+    try
+    {
+        for (size_t i = 1; i < n_workers; i++)
+            threads.emplace_back(worker);
+    }
+    catch (...)
+    {
+        // a thread that could not be started leaves the running ones joinable, which must not be destroyed
+        next_stream = streams.size();
+
+        for (auto &thread : threads)
+            thread.join();
+
+        throw;
+    }
+
+    worker();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (auto &error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    return events;
+}
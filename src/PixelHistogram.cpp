@@ -0,0 +1,78 @@
+#include "RD53Event.h"
+
+#include <string>
+
+using namespace RD53;
+
+PixelHistogram::PixelHistogram(const StreamConfig &config)
+    : config_(config), width_(N_QCORES_HORIZONTAL * config.size_qcore_horizontal), height_(N_QCORES_VERTICAL * config.size_qcore_vertical), pixel_offsets_(), n_hits_(0), hits_(), tots_()
+{
+    // this also rejects an unknown qcore size
+    QuarterCore probe(config_);
+
+    for (uint8_t index = 0; index < 16; index++)
+    {
+        auto [col, row] = qcore_layout::PIXEL_OF[config_.size_qcore_horizontal == 8][index];
+
+        pixel_offsets_[index] = col * height_ + row;
+    }
+
+    hits_.resize(width_ * height_);
+    tots_.resize(width_ * height_ * N_TOT_BINS);
+}
+
+void PixelHistogram::fill(const QuarterCore &qcore)
+{
+    uint8_t qcol = qcore.get_col(), qrow = qcore.get_row();
+
+    if (qcol >= N_QCORES_HORIZONTAL || qrow >= N_QCORES_VERTICAL)
+        throw std::out_of_range("Quarter core (" + std::to_string(qcol) + ", " + std::to_string(qrow) + ") is outside of the chip");
+
+    auto [hit_raw, tots] = qcore.get_hit_raw();
+
+    size_t first_pixel = size_t(qcol) * config_.size_qcore_horizontal * height_ + size_t(qrow) * config_.size_qcore_vertical;
+
+    // only the set bits of the hitmap are visited, the ToT of hit index i is nibble i of the packed ToTs
+    for (uint32_t remaining = hit_raw; remaining != 0; remaining &= remaining - 1)
+    {
+        unsigned index = __builtin_ctz(remaining);
+        size_t pixel = first_pixel + pixel_offsets_[index];
+
+        hits_[pixel]++;
+        tots_[pixel * N_TOT_BINS + (tots >> (index * 4) & 0xF)]++;
+    }
+
+    n_hits_ += __builtin_popcount(hit_raw);
+}
+
+void PixelHistogram::fill(const EventBatch &batch)
+{
+    const StreamConfig &config = batch.get_config();
+
+    if (config.size_qcore_horizontal != config_.size_qcore_horizontal || config.size_qcore_vertical != config_.size_qcore_vertical)
+        throw std::invalid_argument("Cannot fill a histogram of another quarter core size");
+
+    for (const QuarterCore &qcore : batch.qcores())
+        fill(qcore);
+}
+
+void PixelHistogram::merge(const PixelHistogram &other)
+{
+    if (other.width_ != width_ || other.height_ != height_ || other.pixel_offsets_ != pixel_offsets_)
+        throw std::invalid_argument("Cannot merge histograms of another quarter core size");
+
+    for (size_t pixel = 0; pixel < hits_.size(); pixel++)
+        hits_[pixel] += other.hits_[pixel];
+
+    for (size_t bin = 0; bin < tots_.size(); bin++)
+        tots_[bin] += other.tots_[bin];
+
+    n_hits_ += other.n_hits_;
+}
+
+void PixelHistogram::clear()
+{
+    std::fill(hits_.begin(), hits_.end(), 0);
+    std::fill(tots_.begin(), tots_.end(), 0);
+    n_hits_ = 0;
+}
@@ -1,4 +1,6 @@
 #include "RD53Event.h"
+#include "BinaryTree.h"
+#include "Tots.h"
 
 #include <bitset>
 #include <iomanip>
@@ -6,22 +8,60 @@
 
 using namespace RD53;
 
-QuarterCore::QuarterCore(const StreamConfig &config, uint8_t col_, uint8_t row_)
-    : config_(&config), col_(col_), row_(row_), is_last_(false), is_neighbour_(false), is_last_in_event_(false), hits_(0), tots_(0)
+QuarterCore::QuarterCore(const StreamConfig &config, uint8_t col_, uint8_t row_) : QuarterCore(col_, row_)
 {
+    set_config(&config);
 }
 
 QuarterCore::QuarterCore(uint8_t col_, uint8_t row_)
-    : config_(nullptr), col_(col_), row_(row_), is_last_(false), is_neighbour_(false), is_last_in_event_(false), hits_(0), tots_(0)
+    : tots_(0), hits_(0), col_(col_), row_(row_), is_last_(false), is_neighbour_(false), is_last_in_event_(false), has_config_(false), wide_(false), compressed_hitmap_(false), drop_tot_(false)
 {
 }
 
+void QuarterCore::set_config(const StreamConfig *config)
+{
+    if (config == nullptr)
+    {
+        has_config_ = false;
+        return;
+    }
+
+    bool square = config->size_qcore_vertical == 4 && config->size_qcore_horizontal == 4;
+    bool wide = config->size_qcore_vertical == 2 && config->size_qcore_horizontal == 8;
+
+    if (!square && !wide)
+        throw std::runtime_error("ERROR: Wrong qcore size: " + std::to_string(config->size_qcore_horizontal) + " x " + std::to_string(config->size_qcore_vertical));
+
+    has_config_ = true;
+    wide_ = wide;
+    compressed_hitmap_ = config->compressed_hitmap;
+    drop_tot_ = config->drop_tot;
+}
+
+StreamConfig QuarterCore::get_config() const
+{
+    _check_config();
+
+    StreamConfig config(_height(), _width());
+
+    config.compressed_hitmap = compressed_hitmap_;
+    config.drop_tot = drop_tot_;
+
+    return config;
+}
+
+void QuarterCore::_check_config() const
+{
+    if (!has_config_)
+        throw std::runtime_error("QuarterCore has no config");
+}
+
 std::pair<bool, uint8_t> QuarterCore::get_hit(uint8_t index) const
 {
     if (index >= 16)
         throw std::invalid_argument("index out of bounds");
 
-    return {hits_ >> index & 0x1, tots_ >> (index * 4) & 0xF};
+    return get_hit_unchecked(index);
 }
 
 std::pair<bool, uint8_t> QuarterCore::get_hit(uint8_t x, uint8_t y) const
@@ -60,38 +100,36 @@ std::pair<uint16_t, uint64_t> QuarterCore::get_hit_raw() const
 
 std::vector<HitCoord> QuarterCore::get_hit_vectors() const
 {
-    if (config_ == nullptr)
-        throw std::runtime_error("QuarterCore has no config");
+    _check_config();
 
     std::vector<HitCoord> result;
-    for (uint8_t x = 0; x < config_->size_qcore_horizontal; x++)
+    result.reserve(__builtin_popcount(hits_));
+
+    // only the set pixels are visited, column by column like the hit map
+    uint8_t row_bits = __builtin_ctz(_height());
+
+    for (uint32_t pixels = qcore_layout::to_pixels(wide_, hits_); pixels != 0; pixels &= pixels - 1)
     {
-        for (uint8_t y = 0; y < config_->size_qcore_vertical; y++)
-        {
-            auto [h, tot] = get_hit(x, y);
+        uint8_t pixel = __builtin_ctz(pixels);
+        uint8_t tot = tots_ >> (qcore_layout::INDEX_OF[wide_][pixel] * 4) & 0xF;
 
-            if (h)
-            {
-                result.push_back({x, y, tot});
-            }
-        }
+        result.push_back({uint16_t(pixel >> row_bits), uint16_t(pixel & (_height() - 1)), tot});
     }
+
     return result;
 }
 
 std::vector<std::vector<std::pair<bool, uint8_t>>> QuarterCore::get_hit_map() const
 {
-    if (config_ == nullptr)
-        throw std::runtime_error("QuarterCore has no config");
+    _check_config();
 
-    std::vector<std::vector<std::pair<bool, uint8_t>>> hit_map(config_->size_qcore_horizontal, std::vector<std::pair<bool, uint8_t>>(config_->size_qcore_vertical));
+    std::vector<std::vector<std::pair<bool, uint8_t>>> hit_map(_width(), std::vector<std::pair<bool, uint8_t>>(_height()));
 
-    for (uint8_t x = 0; x < config_->size_qcore_horizontal; x++)
+    for (uint8_t x = 0; x < _width(); x++)
     {
-        for (uint8_t y = 0; y < config_->size_qcore_vertical; y++)
+        for (uint8_t y = 0; y < _height(); y++)
         {
-            uint8_t index = hit_index(y, x);
-            hit_map[x][y] = {hits_ >> index & 0x1, tots_ >> (index * 4) & 0xF};
+            hit_map[x][y] = get_hit_unchecked(hit_index_unchecked(x, y));
         }
     }
 
@@ -214,6 +252,8 @@ std::pair<int, int> QuarterCore::get_binary_tree() const
 
 std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> QuarterCore::serialize_qcore(bool prev_last_in_col) const
 {
+    _check_config();
+
     std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> qcore_data;
 
     if (prev_last_in_col)
@@ -221,24 +261,30 @@ std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> QuarterCore::seri
         qcore_data.push_back(std::make_tuple(6, col_ + 1, DataTags::COLUMN));
     }
 
-    qcore_data.push_back(std::make_tuple(1, is_last_, DataTags::IS_LAST));
-    qcore_data.push_back(std::make_tuple(1, is_neighbour_, DataTags::IS_NEIGHBOUR));
+    qcore_data.push_back(std::make_tuple(1, bool(is_last_), DataTags::IS_LAST));
+    qcore_data.push_back(std::make_tuple(1, bool(is_neighbour_), DataTags::IS_NEIGHBOUR));
 
     if (!is_neighbour_)
     {
         qcore_data.push_back(std::make_tuple(8, row_, DataTags::ROW));
     }
 
-    auto [bintree, bintree_length] = config_->compressed_hitmap ? get_binary_tree() : std::make_pair<int, int>(std::get<0>(get_hit_raw()), 16);
-
-    qcore_data.push_back(std::make_tuple(bintree_length, bintree, DataTags::HITMAP));
+    if (compressed_hitmap_)
+    {
+        binary_tree::Code code = binary_tree::encode(hits_);
+        qcore_data.push_back(std::make_tuple(code.length, code.bits, DataTags::HITMAP));
+    }
+    else
+    {
+        qcore_data.push_back(std::make_tuple(data_widths::HITMAP_WIDTH, hits_, DataTags::HITMAP));
+    }
 
-    if (!config_->drop_tot)
+    if (!drop_tot_)
     {
 
         for (int8_t i = 15; i >= 0; i--)
         {
-            auto hit = get_hit(i);
+            auto hit = get_hit_unchecked(i);
 
             if (hit.first)
             {
@@ -251,35 +297,42 @@ std::vector<std::tuple<uint8_t, unsigned long long, DataTags>> QuarterCore::seri
     return qcore_data;
 }
 
-uint8_t QuarterCore::hit_index(uint8_t col, uint8_t row) const
+void QuarterCore::serialize_qcore(BitWriter &writer, bool prev_last_in_col) const
 {
-    if (config_ == nullptr)
-        throw std::runtime_error("QuarterCore has no config");
+    _check_config();
 
-    if (col >= config_->size_qcore_horizontal || row >= config_->size_qcore_vertical)
-        throw std::invalid_argument("coordinates (" + std::to_string(col) + ", " + std::to_string(row) + ") out of bounds (" + std::to_string(config_->size_qcore_horizontal) + ", " + std::to_string(config_->size_qcore_vertical) + ")");
+    if (prev_last_in_col)
+        writer.write(col_ + 1, data_widths::COL_WIDTH);
 
-    if (config_->size_qcore_vertical == 2 && config_->size_qcore_horizontal == 8)
-    {
-        // the hits are mapped in qcore like:
-        // 0  1   2  3   4  5   6  7
-        // 8  9  10 11  12 13  14 15
-        return col + 8 * row;
-    }
-    else if (config_->size_qcore_vertical == 4 && config_->size_qcore_horizontal == 4)
-    {
+    writer.write(is_last_ << 1 | is_neighbour_, data_widths::IS_LAST_WIDTH + data_widths::IS_NEIGHBOUR_WIDTH);
+
+    if (!is_neighbour_)
+        writer.write(row_, data_widths::ROW_WIDTH);
 
-        // the hits are mappend in qcore like:
-        // 0  2  4  6
-        // 1  3  5  7
-        // 8 10 12 14
-        // 9 11 13 15
-        return row > 1 ? 8 + col * 2 + row - 2 : col * 2 + row;
+    if (compressed_hitmap_)
+    {
+        binary_tree::Code code = binary_tree::encode(hits_);
+        writer.write(code.bits, code.length);
     }
     else
     {
-        throw std::runtime_error("ERROR: Wrong qcore size: " + std::to_string(config_->size_qcore_horizontal) + " x " + std::to_string(config_->size_qcore_vertical));
+        writer.write(hits_, data_widths::HITMAP_WIDTH);
     }
+
+    // the ToTs of all hits form one block, the highest hit index first
+    if (!drop_tot_)
+        writer.write(tots::compress(hits_, tots_), data_widths::TOT_WIDTH * tots::count(hits_));
+}
+
+uint8_t QuarterCore::hit_index(uint8_t col, uint8_t row) const
+{
+    _check_config();
+
+    if (col >= _width() || row >= _height())
+        throw std::invalid_argument("coordinates (" + std::to_string(col) + ", " + std::to_string(row) + ") out of bounds (" + std::to_string(_width()) + ", " + std::to_string(_height()) + ")");
+
+    // the mapping of both geometries is described in QcoreLayout.h
+    return hit_index_unchecked(col, row);
 }
 
 // Implementation of the << operator
@@ -296,7 +349,7 @@ std::string QuarterCore::as_str() const
     str << std::left << "  Hits (raw): " << std::right << std::setw(10) << std::bitset<16>(hits_) << "\n";
     str << std::left << "  Tot Values: " << std::right << std::setw(10) << std::hex << std::setw(16) << std::setfill('0') << tots_ << "\n";
 
-    if (config_ != nullptr)
+    if (has_config_)
     {
         auto hit_map = get_hit_map();
         str << "  Hit Map:\n";
@@ -0,0 +1,144 @@
+#include "RD53Event.h"
+
+#include <exception>
+#include <limits>
+
+using namespace RD53;
+
+StreamDecoder::StreamDecoder(const StreamConfig &config) : decoder_(config, StreamView()), buffer_(), ready_(), emitted_(0), chip_id_(0), skipping_(false)
+{
+}
+
+size_t StreamDecoder::push(StreamView words)
+{
+    size_t n_ready = ready_.size();
+
+    size_t begin = 0;
+
+    std::exception_ptr error;
+
+    while (begin < words.size)
+    {
+        // split the chunk at the end of stream words
+        size_t end = begin;
+
+        while (end < words.size && (words[end] >> 63) == 0)
+            end++;
+
+        bool complete = end < words.size;
+
+        if (complete)
+            end++;
+
+        try
+        {
+            _append(StreamView(words.data + begin, end - begin), complete);
+        }
+        catch (...)
+        {
+            // the streams after a corrupt one are still decoded
+            if (!error)
+                error = std::current_exception();
+        }
+
+        begin = end;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return ready_.size() - n_ready;
+}
+
+std::vector<Event> StreamDecoder::pop_events()
+{
+    std::vector<Event> events;
+
+    events.swap(ready_);
+
+    return events;
+}
+
+void StreamDecoder::_append(StreamView words, bool complete)
+{
+    if (skipping_)
+    {
+        // the stream already ended through a zero column, drop the remaining padding words
+        skipping_ = !complete;
+        return;
+    }
+
+    try
+    {
+        bool first = buffer_.empty();
+
+        if (first)
+            chip_id_ = words[0] >> 61 & 0b11;
+
+        if (decoder_.config_.chip_id)
+        {
+            for (auto &word : words)
+            {
+                if ((word >> 61 & 0b11) != chip_id_)
+                    throw std::logic_error("Chip ID in stream has a mismatch");
+            }
+        }
+
+        // the words before the one the reader is in are decoded, only the rest of the stream is kept
+        size_t dropped = first ? 0 : std::min(decoder_.reader_.position() / decoder_.reader_.payload_bits(), buffer_.size());
+
+        buffer_.erase(buffer_.begin(), buffer_.begin() + dropped);
+        buffer_.insert(buffer_.end(), words.begin(), words.end());
+
+        if (first)
+        {
+            decoder_.stream_ = StreamView(buffer_);
+            decoder_._start();
+        }
+        else
+        {
+            decoder_._rebind(StreamView(buffer_), dropped);
+        }
+
+        // only decode while the next field is guaranteed to be buffered, unless nothing more will arrive
+        bool running = decoder_._decode(complete ? std::numeric_limits<size_t>::max() : decoder_.reader_.size());
+
+        _emit(!running);
+
+        if (!running)
+        {
+            _reset();
+            skipping_ = !complete;
+        }
+    }
+    catch (...)
+    {
+        // drop the corrupt stream, the words up to its end of stream are discarded as they arrive
+        _reset();
+        skipping_ = !complete;
+
+        throw;
+    }
+}
+
+void StreamDecoder::_reset()
+{
+    buffer_.clear();
+    decoder_.batch_.clear();
+    emitted_ = 0;
+}
+
+void StreamDecoder::_emit(bool finished)
+{
+    const EventBatch &batch = decoder_.batch_;
+
+    size_t n_complete = finished ? batch.n_triggers() : batch.n_triggers() - 1;
+
+    for (; emitted_ < n_complete; emitted_++)
+    {
+        ready_.push_back(batch.get_event(emitted_));
+
+        if (decoder_.config_.chip_id)
+            ready_.back().header.chip_id = chip_id_;
+    }
+}
@@ -1,7 +1,44 @@
 #include "RD53Event.h"
 
+#include <atomic>
+#include <exception>
+#include <thread>
+
 using namespace RD53;
 
+namespace
+{
+    /**
+     * @brief Routes the hits of a module to its four chips in a single pass
+     *
+     * Chip 0 and 1 cover the left half of the module, chip 1 and 3 the upper half. Every chip gets at least one frame,
+     * so a module without frames still encodes an empty trigger per chip.
+     */
+    struct ChipRouter
+    {
+        ChipRouter(const StreamConfig &config, size_t n_frames)
+            : chip_width(config.size_qcore_horizontal * N_QCORES_HORIZONTAL), chip_height(config.size_qcore_vertical * N_QCORES_VERTICAL)
+        {
+            for (auto &subframe : subframes)
+                subframe.resize(std::max<size_t>(n_frames, 1));
+        }
+
+        /** @brief Appends a module hit to its chip, in chip coordinates */
+        void route(size_t frame, uint16_t x, uint16_t y, uint8_t tot)
+        {
+            uint8_t chip = (x >= chip_width) << 1 | (y >= chip_height);
+
+            subframes[chip][frame].emplace_back(x % chip_width, y % chip_height, tot);
+        }
+
+        const uint16_t chip_width;
+        const uint16_t chip_height;
+
+        /** @brief The hits of every frame of every chip */
+        std::array<std::vector<std::vector<HitCoord>>, 4> subframes;
+    };
+}
+
 TEPXEvent::TEPXEvent(const StreamConfig &config_, const StreamHeader &header_, const std::vector<HitCoord> &hits_)
     : TEPXEvent(config_, header_, std::vector<std::vector<HitCoord>>{hits_})
 {
@@ -9,73 +46,105 @@ TEPXEvent::TEPXEvent(const StreamConfig &config_, const StreamHeader &header_, c
 
 
 TEPXEvent::TEPXEvent(const StreamConfig &config_, const StreamHeader &header_, const std::vector<std::vector<HitCoord>> &frames_)
-    : config(config_), header(header_), frames(frames_)
+    : config(config_), header(header_)
 {
-    const uint64_t chip_height = config.size_qcore_vertical * N_QCORES_VERTICAL;
-    const uint64_t chip_width = config.size_qcore_horizontal * N_QCORES_HORIZONTAL;
+    ChipRouter router(config, frames_.size());
 
-    std::array<std::vector<std::vector<HitCoord>>, 4> subframes;
+    for (size_t i = 0; i < frames_.size(); i++)
+    {
+        for (const auto &[x, y, tot] : frames_[i])
+            router.route(i, x, y, tot);
+    }
+
+    _set_chips(router.subframes);
+}
 
-    auto shift_hit = [chip_height, chip_width](HitCoord hit)
+TEPXEvent::TEPXEvent(const StreamConfig &config_, const StreamHeader &header_, const HitBuffer &hits_)
+    : config(config_), header(header_)
+{
+    ChipRouter router(config, hits_.n_frames());
+
+    const auto &cols = hits_.cols(), &rows = hits_.rows();
+    const auto &tots = hits_.tots();
+
+    for (size_t i = 0; i < hits_.n_frames(); i++)
     {
-        auto [x, y, tot] = hit;
-        return HitCoord(x % chip_width, y % chip_height, tot);
-    };
+        for (size_t hit = hits_.offsets()[i]; hit < hits_.offsets()[i + 1]; hit++)
+            router.route(i, cols[hit], rows[hit], tots[hit]);
+    }
+
+    _set_chips(router.subframes);
+}
 
+void TEPXEvent::_set_chips(const std::array<std::vector<std::vector<HitCoord>>, 4> &subframes)
+{
     for (uint8_t i = 0; i < 4; i++)
     {
+        StreamHeader h = header;
 
-        auto is_in_quadrant = [i, chip_height, chip_width](HitCoord hit)
-        {
-            auto [x, y, tot] = hit;
-
-            switch (i)
-            {
-            case 0:
-                return x < chip_width && y < chip_height;
-            case 1:
-                return x < chip_width && y >= chip_height;
-            case 2:
-                return x >= chip_width && y < chip_height;
-            case 3:
-                return x >= chip_width && y >= chip_height;
-            }
+        h.chip_id = i;
 
-            return false;
-        };
+        chips[i] = Event(config, h, subframes[i]);
 
-        for (auto frame : frames)
-        {
-            subframes[i].push_back(std::vector<HitCoord>());
+        for (const auto &frame : subframes[i])
+            n_hits_ += frame.size();
+    }
+}
 
-            auto & subframe = subframes[i][subframes[i].size() - 1];
+std::array<std::vector<word_t>, 4> TEPXEvent::serialize_event(unsigned n_threads)
+{
+    std::array<std::vector<word_t>, 4> result;
+    std::array<std::exception_ptr, 4> errors;
 
+    // below the threshold starting the threads costs more than they save
+    if (n_threads == 0)
+        n_threads = n_hits_ < MIN_PARALLEL_HITS ? 1 : std::max(1u, std::thread::hardware_concurrency());
 
-            std::copy_if(frame.begin(), frame.end(), std::back_inserter(subframe), is_in_quadrant);
+    std::atomic<uint8_t> next_chip(0);
 
-            std::vector<HitCoord> tmp;
+    // the chips are independent, workers pull the next one from a shared counter
+    auto worker = [&]()
+    {
+        for (uint8_t i = next_chip++; i < 4; i = next_chip++)
+        {
+            try
+            {
+                result[i] = chips[i].serialize_event();
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
 
-            std::transform(subframe.begin(), subframe.end(), std::back_inserter(tmp), shift_hit);
+    std::vector<std::thread> threads;
 
-            subframe = tmp;
-        }
-    
-        StreamHeader h = header;
+    try
+    {
+        for (unsigned i = 1; i < std::min(n_threads, 4u); i++)
+            threads.emplace_back(worker);
+    }
+    catch (...)
+    {
+        // a thread that could not be started leaves the running ones joinable, which must not be destroyed
+        next_chip = 4;
 
-        h.chip_id = i;
+        for (auto &thread : threads)
+            thread.join();
 
-        chips[i] = Event(config, h, subframes[i]);
+        throw;
     }
 
-}
+    worker();
 
-std::array<std::vector<word_t>, 4> TEPXEvent::serialize_event()
-{
-    std::array<std::vector<word_t>, 4> result;
+    for (auto &thread : threads)
+        thread.join();
 
-    for (uint8_t i = 0; i < 4; i++)
+    for (auto &error : errors)
     {
-        result[i] = chips[i].serialize_event();
+        if (error)
+            std::rethrow_exception(error);
     }
 
     return result;
@@ -0,0 +1,40 @@
+#include "Tots.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace RD53;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("bmi2"))) uint64_t tots::expand_bmi2(uint16_t hit_raw, uint64_t packed)
+{
+    // spread every hit bit to the lowest bit of its nibble and fill the nibble
+    uint64_t nibble_mask = _pdep_u64(hit_raw, 0x1111111111111111ull) * 0xF;
+
+    return _pdep_u64(packed, nibble_mask);
+}
+
+__attribute__((target("bmi2"))) uint64_t tots::compress_bmi2(uint16_t hit_raw, uint64_t tots)
+{
+    return _pext_u64(tots, _pdep_u64(hit_raw, 0x1111111111111111ull) * 0xF);
+}
+
+const bool tots::has_bmi2 = __builtin_cpu_supports("bmi2");
+
+#else
+
+uint64_t tots::expand_bmi2(uint16_t hit_raw, uint64_t packed)
+{
+    return expand_portable(hit_raw, packed);
+}
+
+uint64_t tots::compress_bmi2(uint16_t hit_raw, uint64_t tots)
+{
+    return compress_portable(hit_raw, tots);
+}
+
+const bool tots::has_bmi2 = false;
+
+#endif
@@ -32,6 +32,8 @@ std::ostream &operator<<(std::ostream &os, DataTags tag)
         return os << "S3";
     case DataTags::HITPAIR:
         return os << "HITPAIR";
+    case DataTags::END_OF_STREAM:
+        return os << "END_OF_STREAM";
     default:
         return os << "UNKNOWN";
     }
@@ -39,5 +41,5 @@ std::ostream &operator<<(std::ostream &os, DataTags tag)
 
 const std::string set_color(std::pair<Color, Color> color_pair)
 {
-    return fgc[color_pair.first] + bgc[color_pair.second];
+    return fgc.at(color_pair.first) + bgc.at(color_pair.second);
 }
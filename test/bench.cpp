@@ -0,0 +1,717 @@
+#include "RD53Event.h"
+#include "BinaryTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace RD53;
+
+/** @brief Receives results that are otherwise unused */
+static volatile uint64_t sink;
+
+/**
+ * @brief Generates a random frame with roughly the requested pixel occupancy
+ */
+static std::vector<HitCoord> random_hits(const StreamConfig &config, double occupancy)
+{
+    const int width = N_QCORES_HORIZONTAL * config.size_qcore_horizontal;
+    const int height = N_QCORES_VERTICAL * config.size_qcore_vertical;
+
+    std::vector<HitCoord> hits;
+
+    for (int x = 0; x < width; x++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            if (std::rand() < occupancy * RAND_MAX)
+                hits.push_back(HitCoord(x, y, std::rand() % 16));
+        }
+    }
+
+    return hits;
+}
+
+/**
+ * @brief Runs `func` repeatedly for at least `min_seconds` and returns the average time per call in seconds
+ */
+template <typename F>
+static double time_it(F &&func, double min_seconds = 0.5)
+{
+    using clock = std::chrono::steady_clock;
+
+    size_t iterations = 0;
+    auto start = clock::now();
+    double elapsed = 0;
+
+    do
+    {
+        func();
+        iterations++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_seconds);
+
+    return elapsed / iterations;
+}
+
+static void bench_decode(const std::string &name, const StreamConfig &config, double occupancy)
+{
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    Event event(config, header, random_hits(config, occupancy));
+
+    std::vector<word_t> stream = event.serialize_event();
+
+    double t = time_it([&]()
+                       {
+        Decoder decoder(config, stream);
+        decoder.process_stream(); });
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %" << std::setw(10) << stream.size() << " words"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t * 1e6 << " us"
+              << std::setw(12) << std::setprecision(1) << stream.size() * sizeof(word_t) / t / 1e6 << " MB/s" << std::endl;
+}
+
+/**
+ * @brief Compares QuarterCore::get_binary_tree with the encoding table over all hitmaps
+ */
+static void bench_binary_tree()
+{
+    QuarterCore qcore;
+    uint64_t checksum = 0;
+
+    double t_routine = time_it([&]()
+                               {
+        for (uint32_t hits = 1; hits <= 0xFFFF; hits++)
+        {
+            qcore.set_hit_raw(hits, 0);
+            checksum += qcore.get_binary_tree().first;
+        } });
+
+    double t_table = time_it([&]()
+                             {
+        for (uint32_t hits = 1; hits <= 0xFFFF; hits++)
+            checksum += binary_tree::encode(hits).bits; });
+
+    std::cout << std::left << std::setw(28) << "get_binary_tree" << std::right << std::setw(12) << std::fixed << std::setprecision(2) << t_routine / 0xFFFF * 1e9 << " ns/hitmap" << std::endl;
+    std::cout << std::left << std::setw(28) << "binary_tree::encode" << std::right << std::setw(12) << std::fixed << std::setprecision(2) << t_table / 0xFFFF * 1e9 << " ns/hitmap"
+              << std::setw(8) << std::setprecision(1) << t_routine / t_table << " x" << std::endl;
+
+    // keeps the loops from being optimized away
+    sink = checksum;
+}
+
+static void bench_encode(const std::string &name, const StreamConfig &config, double occupancy)
+{
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    Event event(config, header, random_hits(config, occupancy));
+
+    // convert the hits to quarter cores once, only the encoding is timed
+    std::vector<word_t> stream = event.serialize_event();
+
+    double t = time_it([&]()
+                       { event.serialize_event(); });
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %" << std::setw(10) << stream.size() << " words"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t * 1e6 << " us"
+              << std::setw(12) << std::setprecision(1) << stream.size() * sizeof(word_t) / t / 1e6 << " MB/s" << std::endl;
+}
+
+/**
+ * @brief Times building the quarter cores of an event from its hits
+ */
+static void bench_qcores(const std::string &name, const StreamConfig &config, double occupancy)
+{
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    std::vector<HitCoord> hits = random_hits(config, occupancy);
+
+    double t = time_it([&]()
+                       { sink = Event(config, header, hits).get_qcores()[0].size(); });
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %" << std::setw(10) << hits.size() << " hits"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t * 1e6 << " us" << std::endl;
+}
+
+/**
+ * @brief Times building and encoding a TEPX event, a module of 2 x 2 chips, with a growing number of threads
+ */
+static void bench_tepx(const StreamConfig &config, double occupancy)
+{
+    // the hits of the four chips next to each other
+    std::vector<HitCoord> hits;
+
+    for (uint8_t chip = 0; chip < 4; chip++)
+    {
+        for (auto [x, y, tot] : random_hits(config, occupancy))
+            hits.push_back(HitCoord(x + (chip >> 1) * N_QCORES_HORIZONTAL * config.size_qcore_horizontal, y + (chip & 1) * N_QCORES_VERTICAL * config.size_qcore_vertical, tot));
+    }
+
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    double t_build = time_it([&]()
+                             { TEPXEvent event(config, header, hits); });
+
+    std::cout << std::left << std::setw(28) << "tepx build" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %" << std::setw(10) << hits.size() << " hits"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_build * 1e6 << " us" << std::endl;
+
+    TEPXEvent event(config, header, hits);
+
+    double t_single = 0, t_all = 0;
+
+    for (unsigned n_threads = 1; n_threads <= 4; n_threads *= 2)
+    {
+        double t = time_it([&]()
+                           { event.serialize_event(n_threads); });
+
+        if (n_threads == 1)
+            t_single = t;
+
+        t_all = t;
+
+        std::cout << std::left << std::setw(28) << "tepx encode" << std::right << std::setw(3) << n_threads << " threads"
+                  << std::setw(12) << std::fixed << std::setprecision(1) << t * 1e6 << " us"
+                  << std::setw(8) << std::setprecision(2) << t_single / t << " x" << std::endl;
+    }
+
+    // the default picks serial or parallel encoding from the hit count, compared with always using 4 threads
+    double t_auto = time_it([&]()
+                            { event.serialize_event(); });
+
+    unsigned n_auto = hits.size() < TEPXEvent::MIN_PARALLEL_HITS ? 1 : std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+
+    std::cout << std::left << std::setw(28) << "tepx encode default" << std::right << std::setw(3) << n_auto << " threads"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_auto * 1e6 << " us"
+              << std::setw(8) << std::setprecision(2) << t_all / t_auto << " x" << std::endl;
+}
+
+/**
+ * @brief Compares getting the hits of a multi-trigger stream through the nested events and through the flat batch
+ */
+static void bench_batch(const StreamConfig &config, double occupancy, size_t n_triggers)
+{
+    std::vector<std::vector<HitCoord>> frames;
+
+    for (size_t i = 0; i < n_triggers; i++)
+        frames.push_back(random_hits(config, occupancy));
+
+    std::vector<word_t> stream = Event(config, StreamHeader(13, 0, 0, 200, 500), frames).serialize_event();
+
+    Decoder decoder(config, stream);
+
+    double t_nested = time_it([&]()
+                              {
+        decoder.process_stream();
+        sink = decoder.get_event().get_hits().size(); });
+
+    double t_batch = time_it([&]()
+                             {
+        decoder.process_stream();
+        sink = decoder.get_batch().get_hits().size(); });
+
+    std::cout << std::left << std::setw(28) << "hits via nested events" << std::right << std::setw(3) << n_triggers << " triggers"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_nested * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "hits via batch" << std::right << std::setw(3) << n_triggers << " triggers"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_batch * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_nested / t_batch << " x" << std::endl;
+}
+
+/**
+ * @brief Compares filling per-pixel ToT histograms through hit tuples with filling them from the quarter cores
+ */
+static void bench_histogram(const StreamConfig &config, double occupancy)
+{
+    std::vector<word_t> stream = Event(config, StreamHeader(13, 0, 0, 200, 500), random_hits(config, occupancy)).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    const size_t height = N_QCORES_VERTICAL * config.size_qcore_vertical;
+    std::vector<uint32_t> tots(N_QCORES_HORIZONTAL * config.size_qcore_horizontal * height * 16);
+
+    double t_tuples = time_it([&]()
+                              {
+        for (auto &[col, row, tot] : decoder.get_batch().get_hits().get_frame(0))
+            tots[(col * height + row) * 16 + tot]++; });
+
+    PixelHistogram histogram(config);
+
+    double t_histogram = time_it([&]()
+                                 { histogram.fill(decoder.get_batch()); });
+
+    std::cout << std::left << std::setw(28) << "histogram via hit tuples" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_tuples * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "histogram from qcores" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_histogram * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_tuples / t_histogram << " x" << std::endl;
+}
+
+/**
+ * @brief Compares clustering hit tuples through a hash map of neighbours with clustering the quarter core hitmaps
+ */
+static void bench_clusters(const StreamConfig &config, double occupancy)
+{
+    std::vector<word_t> stream = Event(config, StreamHeader(13, 0, 0, 200, 500), random_hits(config, occupancy)).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    double t_tuples = time_it([&]()
+                              {
+        std::unordered_map<uint32_t, uint8_t> remaining;
+        size_t n_clusters = 0;
+
+        for (auto &[col, row, tot] : decoder.get_batch().get_hits().get_frame(0))
+            remaining[uint32_t(col) << 16 | row] = tot;
+
+        while (!remaining.empty())
+        {
+            std::vector<uint32_t> todo = {remaining.begin()->first};
+            remaining.erase(remaining.begin());
+            n_clusters++;
+
+            while (!todo.empty())
+            {
+                int col = todo.back() >> 16, row = todo.back() & 0xFFFF;
+                todo.pop_back();
+
+                for (int dcol = -1; dcol <= 1; dcol++)
+                {
+                    for (int drow = -1; drow <= 1; drow++)
+                    {
+                        auto found = remaining.find(uint32_t(col + dcol) << 16 | uint16_t(row + drow));
+
+                        if (found != remaining.end())
+                        {
+                            todo.push_back(found->first);
+                            remaining.erase(found);
+                        }
+                    }
+                }
+            }
+        }
+
+        sink = n_clusters; });
+
+    Clusterer clusterer(config);
+    std::vector<Cluster> clusters;
+
+    double t_clusterer = time_it([&]()
+                                 {
+        clusters.clear();
+        sink = clusterer.cluster(decoder.get_batch(), clusters); });
+
+    std::cout << std::left << std::setw(28) << "clusters via hash map" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_tuples * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "clusters from hitmaps" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_clusterer * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_tuples / t_clusterer << " x" << std::endl;
+}
+
+/**
+ * @brief Compares finding the pixels hit in two triggers through sorted hit tuples and through chip bitmaps
+ */
+static void bench_bitmap(const StreamConfig &config, double occupancy)
+{
+    std::vector<std::vector<HitCoord>> frames = {random_hits(config, occupancy), random_hits(config, occupancy)};
+    std::vector<word_t> stream = Event(config, StreamHeader(13, 0, 0, 200, 500), frames).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    const EventBatch &batch = decoder.get_batch();
+
+    double t_tuples = time_it([&]()
+                              {
+        HitBuffer hits = batch.get_hits();
+        std::vector<std::pair<uint16_t, uint16_t>> first, second, both;
+
+        for (size_t i = hits.offsets()[0]; i < hits.offsets()[1]; i++)
+            first.push_back({hits.cols()[i], hits.rows()[i]});
+        for (size_t i = hits.offsets()[1]; i < hits.offsets()[2]; i++)
+            second.push_back({hits.cols()[i], hits.rows()[i]});
+
+        std::sort(first.begin(), first.end());
+        std::sort(second.begin(), second.end());
+        std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(both));
+
+        sink = both.size(); });
+
+    ChipBitmap first(config), second(config);
+
+    double t_bitmap = time_it([&]()
+                              {
+        first.clear();
+        second.clear();
+        first.add(batch.get_qcores(0));
+        second.add(batch.get_qcores(1));
+
+        sink = (first &= second).count(); });
+
+    std::cout << std::left << std::setw(28) << "common pixels via tuples" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_tuples * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "common pixels via bitmaps" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_bitmap * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_tuples / t_bitmap << " x" << std::endl;
+}
+
+/**
+ * @brief Compares decoding many small streams with a fresh decoder each on the heap and in an arena
+ */
+static void bench_arena(const StreamConfig &config, double occupancy, size_t n_triggers)
+{
+    std::vector<std::vector<HitCoord>> frames;
+
+    for (size_t i = 0; i < n_triggers; i++)
+        frames.push_back(random_hits(config, occupancy));
+
+    std::vector<word_t> stream = Event(config, StreamHeader(13, 0, 0, 200, 500), frames).serialize_event();
+
+    double t_heap = time_it([&]()
+                            {
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+        sink = decoder.get_batch().qcores().size(); });
+
+    Arena arena;
+
+    double t_arena = time_it([&]()
+                             {
+        {
+            Decoder decoder(config, stream, &arena);
+            decoder.process_stream();
+            sink = decoder.get_batch().qcores().size();
+        }
+        arena.reset(); });
+
+    std::cout << std::left << std::setw(28) << "decode on the heap" << std::right << std::setw(3) << n_triggers << " triggers"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_heap * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "decode in an arena" << std::right << std::setw(3) << n_triggers << " triggers"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_arena * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_heap / t_arena << " x" << std::endl;
+}
+
+/**
+ * @brief Compares getting pixel hits through the decoded quarter cores with decoding straight into pixel hits
+ */
+static void bench_hits(const StreamConfig &config, double occupancy)
+{
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    std::vector<word_t> stream = Event(config, header, random_hits(config, occupancy)).serialize_event();
+
+    double t_qcores = time_it([&]()
+                              {
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+        decoder.get_event().get_hits(); });
+
+    std::vector<PixelHit> hits;
+
+    double t_hits = time_it([&]()
+                            {
+        hits.clear();
+        Decoder(config, stream).decode_hits(hits); });
+
+    HitBuffer buffer;
+
+    double t_buffer = time_it([&]()
+                              {
+        buffer.clear();
+        Decoder(config, stream).decode_hits(buffer); });
+
+    std::cout << std::left << std::setw(28) << "hits via qcores" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_qcores * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "hits direct" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_hits * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_qcores / t_hits << " x" << std::endl;
+    std::cout << std::left << std::setw(28) << "hits into HitBuffer" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_buffer * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_qcores / t_buffer << " x" << std::endl;
+}
+
+/**
+ * @brief Compares a full decode with counting the hits per pixel only
+ */
+static void bench_occupancy(const StreamConfig &config, double occupancy)
+{
+    StreamHeader header = {13, 1, 0, 200, 500};
+
+    std::vector<word_t> stream = Event(config, header, random_hits(config, occupancy)).serialize_event();
+
+    double t_full = time_it([&]()
+                            {
+        Decoder decoder(config, stream);
+        decoder.process_stream(); });
+
+    std::vector<uint32_t> counters;
+
+    double t_occupancy = time_it([&]()
+                                 { Decoder(config, stream).decode_occupancy(counters); });
+
+    std::cout << std::left << std::setw(28) << "full decode" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_full * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "occupancy only" << std::right << std::setw(7) << std::fixed << std::setprecision(1) << occupancy * 100 << " %"
+              << std::setw(12) << t_occupancy * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_full / t_occupancy << " x" << std::endl;
+}
+
+static void bench_parallel(const StreamConfig &config, double occupancy, size_t n_streams)
+{
+    std::vector<std::vector<word_t>> streams;
+    std::vector<StreamView> views;
+
+    for (size_t i = 0; i < n_streams; i++)
+        streams.push_back(Event(config, StreamHeader(i % 64, 0, i % 4), random_hits(config, occupancy)).serialize_event());
+
+    size_t n_words = 0;
+
+    for (auto &stream : streams)
+    {
+        views.push_back(StreamView(stream));
+        n_words += stream.size();
+    }
+
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    double t_single = 0;
+
+    for (unsigned n_threads = 1;; n_threads = std::min(n_threads * 2, max_threads))
+    {
+        ParallelDecoder decoder(config, n_threads);
+
+        double t = time_it([&]()
+                           { decoder.decode(views); });
+
+        if (n_threads == 1)
+            t_single = t;
+
+        std::cout << std::left << std::setw(28) << "parallel decode" << std::right << std::setw(3) << n_threads << " threads"
+                  << std::setw(6) << n_streams << " streams"
+                  << std::setw(12) << std::fixed << std::setprecision(1) << n_words * sizeof(word_t) / t / 1e6 << " MB/s"
+                  << std::setw(8) << std::setprecision(2) << t_single / t << " x" << std::endl;
+
+        if (n_threads == max_threads)
+            break;
+    }
+}
+
+/**
+ * @brief Compares reading a capture file into a vector with mapping it, both split into streams and decoded
+ */
+static void bench_capture(const StreamConfig &config, double occupancy, size_t n_streams)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "rd53event_bench_capture.bin").string();
+
+    size_t n_words = 0;
+
+    {
+        std::ofstream file(path, std::ios::binary);
+
+        for (size_t i = 0; i < n_streams; i++)
+        {
+            std::vector<word_t> stream = Event(config, StreamHeader(i % 64, 0, i % 4), random_hits(config, occupancy)).serialize_event();
+
+            file.write(reinterpret_cast<const char *>(stream.data()), stream.size() * sizeof(word_t));
+            n_words += stream.size();
+        }
+    }
+
+    HitBuffer hits;
+
+    // splitting alone shows the cost of getting at the words, decoding as well the share of it in a full pass
+    for (bool decode : {false, true})
+    {
+        size_t n_found = 0;
+
+        auto consume = [&](StreamView stream)
+        {
+            n_found++;
+
+            if (decode)
+            {
+                hits.clear();
+                Decoder(config, stream).decode_hits(hits);
+            }
+        };
+
+        double t_read = time_it([&]()
+                                {
+            std::ifstream file(path, std::ios::binary);
+            std::vector<word_t> words(n_words);
+            file.read(reinterpret_cast<char *>(words.data()), n_words * sizeof(word_t));
+
+            for (size_t begin = 0, end = 0; begin < words.size(); begin = end)
+            {
+                while ((words[end++] >> 63) == 0)
+                    ;
+
+                consume(StreamView(words.data() + begin, end - begin));
+            }
+
+            sink = n_found; });
+
+        double t_map = time_it([&]()
+                               {
+            CaptureFile capture(path);
+            StreamView stream;
+
+            while (capture.next(stream))
+                consume(stream);
+
+            sink = n_found; });
+
+        std::string what = decode ? " + decode" : " + split";
+
+        std::cout << std::left << std::setw(28) << "capture read" + what << std::right << std::setw(6) << n_streams << " streams"
+                  << std::setw(12) << std::fixed << std::setprecision(1) << n_words * sizeof(word_t) / t_read / 1e6 << " MB/s" << std::endl;
+        std::cout << std::left << std::setw(28) << "capture mmap" + what << std::right << std::setw(6) << n_streams << " streams"
+                  << std::setw(12) << std::fixed << std::setprecision(1) << n_words * sizeof(word_t) / t_map / 1e6 << " MB/s"
+                  << std::setw(8) << std::setprecision(2) << t_read / t_map << " x" << std::endl;
+    }
+
+    std::filesystem::remove(path);
+}
+
+/**
+ * @brief Compares finding and decoding the last trigger of a capture by rescanning it with loading its sidecar index
+ */
+static void bench_capture_index(const StreamConfig &config, double occupancy, size_t n_streams)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "rd53event_bench_index.bin").string();
+    std::string sidecar = CaptureIndex::sidecar_path(path);
+
+    {
+        std::ofstream file(path, std::ios::binary);
+
+        for (size_t i = 0; i < n_streams; i++)
+        {
+            std::vector<word_t> stream = Event(config, StreamHeader(i % 64, 0, i % 4, i), random_hits(config, occupancy)).serialize_event();
+
+            file.write(reinterpret_cast<const char *>(stream.data()), stream.size() * sizeof(word_t));
+        }
+    }
+
+    const uint8_t wanted = (n_streams - 1) % 64;
+
+    HitBuffer hits;
+
+    double t_scan = time_it([&]()
+                            {
+        CaptureFile capture(path);
+        StreamView stream, found;
+
+        // the tags wrap around, the last stream with the tag is wanted
+        while (capture.next(stream))
+        {
+            if (Decoder::peek_header(config, stream).trigger_tag == wanted)
+                found = stream;
+        }
+
+        hits.clear();
+        Decoder(config, found).decode_hits(hits);
+        sink = hits.n_frames(); });
+
+    double t_build = time_it([&]()
+                             {
+        CaptureFile capture(path);
+        CaptureIndex(capture, config).save(sidecar); });
+
+    double t_index = time_it([&]()
+                             {
+        CaptureFile capture(path);
+        CaptureIndex index = CaptureIndex::open(capture, config);
+
+        size_t found = index.size();
+
+        for (size_t i = index.find_trigger_tag(wanted); i < index.size(); i = index.find_trigger_tag(wanted, i + 1))
+            found = i;
+
+        hits.clear();
+        Decoder(config, index.stream(capture, found)).decode_hits(hits);
+        sink = hits.n_frames(); });
+
+    std::filesystem::remove(sidecar);
+    std::filesystem::remove(path);
+
+    std::cout << std::left << std::setw(28) << "last trigger by rescan" << std::right << std::setw(6) << n_streams << " streams"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_scan * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "index build and save" << std::right << std::setw(6) << n_streams << " streams"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_build * 1e6 << " us" << std::endl;
+    std::cout << std::left << std::setw(28) << "last trigger by index" << std::right << std::setw(6) << n_streams << " streams"
+              << std::setw(12) << std::fixed << std::setprecision(1) << t_index * 1e6 << " us" << std::setw(8) << std::setprecision(2) << t_scan / t_index << " x" << std::endl;
+}
+
+int main()
+{
+    std::srand(42);
+
+    StreamConfig plain(4, 4, true, false, false, false, true, true);
+    StreamConfig compressed(4, 4, true, false, true, false, true, true);
+
+    for (double occupancy : {0.001, 0.01, 0.1, 1.0})
+    {
+        bench_decode("decode plain", plain, occupancy);
+        bench_decode("decode compressed", compressed, occupancy);
+    }
+
+    bench_binary_tree();
+
+    for (double occupancy : {0.01, 0.1, 1.0})
+    {
+        bench_encode("encode plain", plain, occupancy);
+        bench_encode("encode compressed", compressed, occupancy);
+    }
+
+    for (double occupancy : {0.01, 0.1, 1.0})
+    {
+        bench_qcores("qcores from hits 4x4", plain, occupancy);
+        bench_qcores("qcores from hits 2x8", StreamConfig(2, 8), occupancy);
+    }
+
+    // every combination of the flags the decoder is specialized on
+    for (bool compressed_hitmap : {false, true})
+    {
+        for (bool drop_tot : {false, true})
+        {
+            for (bool chip_id : {false, true})
+            {
+                StreamConfig config(4, 4, chip_id, drop_tot, compressed_hitmap, false, true, true);
+
+                std::string name = std::string(compressed_hitmap ? "compressed" : "plain") + (drop_tot ? " no-tot" : "") + (chip_id ? " chip-id" : "");
+
+                bench_decode(name, config, 0.01);
+            }
+        }
+    }
+
+    for (double occupancy : {0.001, 0.01, 0.1})
+        bench_tepx(compressed, occupancy);
+
+    for (double occupancy : {0.01, 0.1})
+        bench_hits(compressed, occupancy);
+
+    bench_batch(compressed, 0.01, 8);
+    bench_arena(compressed, 0.0002, 8);
+    bench_histogram(compressed, 0.01);
+
+    for (double occupancy : {0.01, 0.1})
+        bench_clusters(compressed, occupancy);
+
+    for (double occupancy : {0.01, 0.1})
+        bench_bitmap(compressed, occupancy);
+
+    for (double occupancy : {0.01, 0.1})
+    {
+        bench_occupancy(plain, occupancy);
+        bench_occupancy(compressed, occupancy);
+    }
+
+    bench_parallel(compressed, 0.01, 256);
+    bench_capture(compressed, 0.01, 1024);
+    bench_capture_index(compressed, 0.01, 1024);
+
+    return 0;
+}
@@ -1,15 +1,1200 @@
 #include "RD53Event.h"
+#include "BinaryTree.h"
+#include "Tots.h"
 
 #include <iostream>
 #include <bitset>
+#include <chrono>
 #include <ctime>
 #include <cassert>
+#include <cstdlib>
+#include <filesystem>
 #include <map>
+#include <new>
+#include <set>
+#include <thread>
 
 using namespace RD53;
 
+/** @brief The number of calls to the global operator new, for the allocation tests */
+static size_t n_heap_allocations = 0;
+
+// none of the replacements is inlined, otherwise GCC sees malloc() and free() meet new and delete expressions and
+// reports -Wmismatched-new-delete
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    n_heap_allocations++;
+
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+__attribute__((noinline)) void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+/**
+ * @brief Asserts that a call throws an exception of the given type
+ */
+template <typename E, typename F>
+void expect_throw(F f)
+{
+    bool thrown = false;
+
+    try
+    {
+        f();
+    }
+    catch (const E &)
+    {
+        thrown = true;
+    }
+
+    assert(thrown);
+}
+
+/**
+ * @brief Generates a deterministic frame of hits spread over the whole chip
+ *
+ * The hits walk the chip with steps that are coprime to its size, so the first few thousand hits of a seed are on
+ * distinct pixels. Different seeds give differently placed frames.
+ */
+std::vector<HitCoord> make_hits(const StreamConfig &config, size_t n, unsigned seed = 0)
+{
+    const size_t width = N_QCORES_HORIZONTAL * config.size_qcore_horizontal, height = N_QCORES_VERTICAL * config.size_qcore_vertical;
+
+    std::vector<HitCoord> hits;
+
+    for (size_t j = 0; j < n; j++)
+        hits.push_back(HitCoord((j * 37 + seed * 5) % width, (j * 101 + seed * 13) % height, (j + seed) % 16));
+
+    return hits;
+}
+
+/**
+ * @brief Reads fields across word boundaries of a stream longer than 65535 words
+ */
+void test_bit_reader()
+{
+    const size_t n_words = 70000;
+
+    // chip ID meta bits set, payload bits alternate in blocks of 61
+    std::vector<word_t> words(n_words);
+    for (size_t i = 0; i < n_words; i++)
+        words[i] = (0b011ull << 61) | (i % 2 ? (1ull << 61) - 1 : 0);
+
+    BitReader reader(words.data(), words.size(), 3);
+
+    assert(reader.size() == n_words * 61);
+
+    reader.seek(65536 * 61 - 2);
+    assert(reader.read(4) == 0b1100);
+    assert(reader.read(61) == 0b11);
+
+    reader.seek(n_words * 61 - 3);
+    assert(reader.read(8) == 0b11100000);
+    assert(reader.overrun());
+}
+
+/**
+ * @brief Checks the hit index tables and the sparse hit accessors against the checked per-pixel lookups
+ */
+void test_qcore_layout()
+{
+    for (auto [width, height] : {std::pair<uint8_t, uint8_t>{4, 4}, {8, 2}})
+    {
+        StreamConfig config(height, width);
+        bool wide = width == 8;
+
+        QuarterCore qcore(config, 3, 7);
+
+        for (uint8_t x = 0; x < width; x++)
+        {
+            for (uint8_t y = 0; y < height; y++)
+            {
+                uint8_t index = qcore.hit_index(x, y);
+
+                assert(qcore.hit_index_unchecked(x, y) == index);
+                assert(qcore_layout::PIXEL_OF[wide][index].col == x && qcore_layout::PIXEL_OF[wide][index].row == y);
+                assert(qcore_layout::to_pixels(wide, 1 << index) == 1 << (x * height + y));
+            }
+        }
+
+        for (uint32_t hits = 0; hits <= 0xFFFF; hits += 13)
+        {
+            qcore.set_hit_raw(hits, 0x0123456789ABCDEFull * (hits | 1));
+
+            // the hits column by column, like the hit map
+            std::vector<HitCoord> expected;
+
+            for (uint8_t x = 0; x < width; x++)
+            {
+                for (uint8_t y = 0; y < height; y++)
+                {
+                    auto [hit, tot] = qcore.get_hit(x, y);
+
+                    if (hit)
+                        expected.push_back({x, y, tot});
+                }
+            }
+
+            assert(qcore.get_hit_vectors() == expected);
+            assert(qcore_layout::to_hits(wide, qcore_layout::to_pixels(wide, hits)) == hits);
+
+            auto hit_map = qcore.get_hit_map();
+            assert(hit_map.size() == width && hit_map[width - 1].size() == height);
+            assert(hit_map[width - 1][0] == qcore.get_hit(width - 1, 0));
+        }
+    }
+}
+
+/**
+ * @brief Encodes and decodes every possible hitmap through the tables and the reference routines
+ */
+void test_binary_tree()
+{
+    QuarterCore qcore;
+
+    for (uint32_t hits = 1; hits <= 0xFFFF; hits++)
+    {
+        qcore.set_hit_raw(hits, 0);
+
+        auto [code, length] = qcore.get_binary_tree();
+
+        std::vector<word_t> words = {(word_t)code << (63 - length)};
+
+        BitReader fast(words.data(), words.size());
+        BitReader slow(words.data(), words.size());
+
+        assert(binary_tree::decode(fast) == hits);
+        assert(binary_tree::decode_slow(slow) == hits);
+        assert(fast.position() == (size_t)length && slow.position() == (size_t)length);
+
+        binary_tree::Code encoded = binary_tree::encode(hits);
+        binary_tree::Code reference = binary_tree::encode_hitmap(hits);
+
+        assert(encoded.bits == (uint32_t)code && encoded.length == length);
+        assert(reference.bits == (uint32_t)code && reference.length == length);
+    }
+}
+
+/**
+ * @brief Feeds several concatenated streams in odd sized chunks and compares with the Decoder
+ */
+void test_stream_decoder()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    std::vector<word_t> words;
+    std::vector<std::vector<HitCoord>> expected;
+
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        std::vector<word_t> stream = Event(config, StreamHeader(i, 1, 2, 10, 20), make_hits(config, 40 * i + 1, i)).serialize_event();
+
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+        expected.push_back(decoder.get_event().get_hits()[0]);
+
+        words.insert(words.end(), stream.begin(), stream.end());
+    }
+
+    StreamDecoder stream_decoder(config);
+    std::vector<Event> events;
+
+    for (size_t begin = 0, chunk = 1; begin < words.size(); begin += chunk, chunk = chunk * 3 % 17 + 1)
+    {
+        stream_decoder.push(StreamView(words.data() + begin, std::min(chunk, words.size() - begin)));
+
+        for (auto &event : stream_decoder.pop_events())
+            events.push_back(event);
+    }
+
+    assert(events.size() == expected.size());
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        assert(events[i].header.trigger_tag == i && events[i].header.chip_id == 2);
+        assert(events[i].get_hits()[0] == expected[i]);
+    }
+
+    // a long stream fed in small chunks only keeps the words that are not decoded yet
+    std::vector<word_t> stream = Event(config, StreamHeader(3, 1, 1, 10, 20), make_hits(config, 20000)).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    const size_t chunk = 4;
+    size_t max_buffered = 0;
+
+    for (size_t begin = 0; begin < stream.size(); begin += chunk)
+    {
+        stream_decoder.push(StreamView(stream.data() + begin, std::min(chunk, stream.size() - begin)));
+        max_buffered = std::max(max_buffered, stream_decoder.n_buffered_words());
+    }
+
+    events = stream_decoder.pop_events();
+
+    assert(stream.size() > 1000 && max_buffered <= chunk + 2);
+    assert(events.size() == 1 && events[0].get_hits() == decoder.get_event().get_hits());
+
+    // a corrupt stream is dropped up to its end of stream, the stream after it decodes as usual
+    std::vector<word_t> corrupt = Event(config, StreamHeader(5, 1, 2, 10, 20), make_hits(config, 2000)).serialize_event();
+    corrupt[corrupt.size() / 2] ^= 1ull << 61;
+
+    size_t split = corrupt.size() / 2 - 10;
+
+    stream_decoder.push(StreamView(corrupt.data(), split));
+    expect_throw<std::logic_error>([&]()
+                                   { stream_decoder.push(StreamView(corrupt.data() + split, 20)); });
+    stream_decoder.push(StreamView(corrupt.data() + split + 20, corrupt.size() - split - 20));
+    stream_decoder.push(StreamView(stream));
+
+    events = stream_decoder.pop_events();
+    assert(events.size() == 1 && events[0].get_hits() == decoder.get_event().get_hits());
+
+    // the same within a single chunk
+    std::vector<word_t> chunk_words = corrupt;
+    chunk_words.insert(chunk_words.end(), stream.begin(), stream.end());
+
+    expect_throw<std::logic_error>([&]()
+                                   { stream_decoder.push(StreamView(chunk_words)); });
+
+    events = stream_decoder.pop_events();
+    assert(events.size() == 1 && events[0].get_hits() == decoder.get_event().get_hits() && stream_decoder.n_buffered_words() == 0);
+}
+
+/**
+ * @brief Decodes independent streams on several threads and compares with the Decoder
+ */
+void test_parallel_decoder()
+{
+    StreamConfig config(4, 4, true, false, false, false, true, false);
+
+    std::vector<std::vector<word_t>> streams;
+    std::vector<StreamView> views;
+
+    for (uint8_t i = 0; i < 32; i++)
+    {
+        streams.push_back(Event(config, StreamHeader(i, 0, i % 4, i), make_hits(config, 50 * i + 1, i)).serialize_event());
+    }
+
+    for (auto &stream : streams)
+        views.push_back(StreamView(stream));
+
+    std::vector<Event> events = ParallelDecoder(config, 4).decode(views);
+
+    assert(events.size() == streams.size());
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        Decoder decoder(config, streams[i]);
+        decoder.process_stream();
+
+        assert(events[i].header.bcid == i && events[i].header.chip_id == i % 4);
+        assert(events[i].get_hits() == decoder.get_event().get_hits());
+    }
+}
+
+/**
+ * @brief Decodes straight into pixel hits and compares with the hits of the decoded quarter cores
+ */
+void test_decode_hits()
+{
+    for (auto [vertical, horizontal] : {std::pair<int, int>{4, 4}, {2, 8}})
+    {
+        for (int flags = 0; flags < 4; flags++)
+        {
+            StreamConfig config(vertical, horizontal, true, flags & 1, flags & 2, false, true, true);
+
+            std::vector<word_t> stream = Event(config, StreamHeader(5, 0, 1, 2, 3), make_hits(config, 3000)).serialize_event();
+
+            Decoder decoder(config, stream);
+            decoder.process_stream();
+
+            std::vector<HitCoord> qcore_hits = decoder.get_event().get_hits()[0];
+            std::vector<PixelHit> expected;
+
+            for (auto [col, row, tot] : qcore_hits)
+                expected.push_back({col, row, config.drop_tot ? uint8_t(0) : tot, 0});
+
+            // appends to what is already in the buffer
+            std::vector<PixelHit> decoded(1);
+
+            assert(Decoder(config, stream).decode_hits(decoded) == expected.size());
+
+            decoded.erase(decoded.begin());
+
+            auto by_pixel = [](const PixelHit &a, const PixelHit &b)
+            { return std::make_pair(a.col, a.row) < std::make_pair(b.col, b.row); };
+
+            std::sort(expected.begin(), expected.end(), by_pixel);
+            std::sort(decoded.begin(), decoded.end(), by_pixel);
+
+            assert(decoded == expected);
+        }
+    }
+}
+
+/**
+ * @brief Counts the hits per pixel over several streams and compares with the decoded pixel hits
+ */
+void test_decode_occupancy()
+{
+    for (auto [vertical, horizontal] : {std::pair<int, int>{4, 4}, {2, 8}})
+    {
+        StreamConfig config(vertical, horizontal, false, false, true, false, false, false);
+
+        const int width = N_QCORES_HORIZONTAL * horizontal, height = N_QCORES_VERTICAL * vertical;
+
+        std::vector<uint32_t> occupancy, expected(width * height);
+
+        for (int i = 0; i < 3; i++)
+        {
+            std::vector<HitCoord> hits = make_hits(config, 500 * (i + 1), i);
+
+            std::vector<word_t> stream = Event(config, StreamHeader(i, 0), hits).serialize_event();
+
+            std::vector<PixelHit> decoded;
+            Decoder(config, stream).decode_hits(decoded);
+
+            for (auto &hit : decoded)
+                expected[hit.col * height + hit.row]++;
+
+            assert(Decoder(config, stream).decode_occupancy(occupancy) == decoded.size());
+        }
+
+        assert(occupancy == expected);
+
+        std::vector<uint32_t> wrong_size(10);
+        expect_throw<std::invalid_argument>([&]()
+                                            { Decoder(config, Event(config, StreamHeader(), {HitCoord(0, 0, 1)}).serialize_event()).decode_occupancy(wrong_size); });
+    }
+}
+
+/**
+ * @brief Encodes an event with several triggers, from hits and from quarter cores, and decodes it again
+ */
+void test_sub_events()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    std::vector<std::vector<HitCoord>> frames(3);
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        std::map<std::pair<uint16_t, uint16_t>, uint8_t> pixels;
+
+        for (auto [x, y, tot] : make_hits(config, 200, i))
+            pixels[{x, y}] = tot;
+
+        for (auto &[pixel, tot] : pixels)
+            frames[i].push_back(HitCoord(pixel.first, pixel.second, tot));
+    }
+
+    Event event(config, StreamHeader(12, 1, 1, 5, 6), frames);
+
+    std::vector<word_t> stream = event.serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    Event decoded = decoder.get_event();
+    std::vector<std::vector<HitCoord>> decoded_frames = decoded.get_hits();
+
+    assert(decoded_frames.size() == frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        std::sort(decoded_frames[i].begin(), decoded_frames[i].end());
+        assert(decoded_frames[i] == frames[i]);
+    }
+
+    // the quarter cores of every trigger encode to the same stream
+    assert(Event(config, event.header, decoded.get_qcores()).serialize_event() == stream);
+}
+
+/**
+ * @brief Checks the order and flags of the quarter cores built from hits, and that hits outside the chip are rejected
+ */
+void test_qcores_from_hits()
+{
+    StreamConfig config(4, 4);
+
+    // qcores (0, 0), (0, 1), (0, 100), (53, 167) and (2, 3), given out of order
+    std::vector<HitCoord> hits = {{0, 401, 3}, {215, 671, 1}, {9, 13, 4}, {1, 2, 2}, {2, 5, 5}, {0, 0, 7}};
+
+    std::vector<QuarterCore> qcores = Event(config, StreamHeader(), hits).get_qcores()[0];
+
+    std::vector<std::tuple<int, int, bool, bool>> expected = {{53, 167, false, true}, {2, 3, false, true}, {0, 0, false, false}, {0, 1, true, false}, {0, 100, false, true}};
+
+    assert(qcores.size() == expected.size());
+
+    for (size_t i = 0; i < qcores.size(); i++)
+    {
+        auto [col, row, is_neighbour, is_last] = expected[i];
+
+        assert(qcores[i].get_col() == col && qcores[i].get_row() == row);
+        assert(qcores[i].get_is_neighbour() == is_neighbour && qcores[i].get_is_last() == is_last);
+        assert(qcores[i].get_is_last_in_event() == (i + 1 == qcores.size()));
+    }
+
+    // the quarter cores carry the geometry of the event, also after leaving it
+    assert(qcores[2].get_config().size_qcore_horizontal == 4 && qcores[2].get_hit_vectors().size() == 2);
+
+    assert(qcores[2].get_hit_raw().first == 0x401 && qcores[2].get_hit_raw().second == (2ull << 40 | 7));
+
+    expect_throw<std::out_of_range>([&]()
+                                    { Event(config, StreamHeader(), std::vector<HitCoord>{{3, 4, 1}, {216, 0, 1}}).serialize_event(); });
+
+    // a rejected event leaves nothing behind for the next one
+    assert(Event(config, StreamHeader(), std::vector<HitCoord>{{0, 0, 1}}).get_qcores()[0].size() == 1);
+}
+
+/**
+ * @brief Checks the routing of module hits to the chips of a TEPX event and the concurrent encoding of the chips
+ */
+void test_tepx_event()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    const uint16_t width = N_QCORES_HORIZONTAL * 4, height = N_QCORES_VERTICAL * 4;
+
+    std::vector<std::vector<HitCoord>> frames(2);
+    std::array<std::vector<std::vector<HitCoord>>, 4> expected;
+
+    for (auto &chip : expected)
+        chip.resize(frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        for (uint16_t x = i; x < 2 * width; x += 7)
+        {
+            for (uint16_t y = 0; y < 2 * height; y += 29)
+            {
+                frames[i].push_back(HitCoord(x, y, (x + y) % 16));
+                expected[(x >= width) << 1 | (y >= height)][i].push_back(HitCoord(x % width, y % height, (x + y) % 16));
+            }
+        }
+    }
+
+    TEPXEvent event(config, StreamHeader(13, 1, 0, 200, 500), frames);
+
+    auto serial = event.serialize_event(1);
+
+    assert(event.serialize_event(4) == serial && event.serialize_event() == serial);
+    assert(event.n_hits() == frames[0].size() + frames[1].size() && event.n_hits() < TEPXEvent::MIN_PARALLEL_HITS);
+
+    for (uint8_t chip = 0; chip < 4; chip++)
+    {
+        assert((serial[chip][0] >> 61 & 0b11) == chip);
+
+        Decoder decoder(config, serial[chip]);
+        decoder.process_stream();
+
+        auto decoded = decoder.get_event().get_hits();
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            std::sort(decoded[i].begin(), decoded[i].end());
+            std::sort(expected[chip][i].begin(), expected[chip][i].end());
+
+            assert(decoded[i] == expected[chip][i]);
+        }
+    }
+
+    // without frames both constructors give every chip one empty frame
+    TEPXEvent from_frames(config, StreamHeader(13, 1), std::vector<std::vector<HitCoord>>());
+    TEPXEvent from_buffer(config, StreamHeader(13, 1), HitBuffer());
+
+    auto empty = from_frames.serialize_event(1);
+
+    assert(from_frames.n_hits() == 0 && empty == from_buffer.serialize_event(1));
+
+    for (const auto &stream : empty)
+    {
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+
+        assert(decoder.get_batch().n_triggers() == 1);
+    }
+}
+
+/**
+ * @brief Checks the HitBuffer frames and decoding into, and encoding from, a HitBuffer
+ */
+void test_hit_buffer()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    // the second trigger has no hits
+    std::vector<std::vector<HitCoord>> frames = {{{3, 4, 5}, {100, 600, 1}}, {}, {{0, 0, 2}, {215, 671, 15}, {7, 8, 9}}};
+
+    HitBuffer buffer(frames);
+
+    assert(buffer.size() == 5 && buffer.n_frames() == 3);
+    assert((buffer.offsets() == std::vector<size_t>{0, 2, 2, 5}));
+    assert(buffer.frame_size(1) == 0 && buffer.cols()[3] == 215 && buffer.rows()[3] == 671 && buffer.tots()[3] == 15);
+    assert(buffer.get_frames() == frames);
+
+    expect_throw<std::logic_error>([&]()
+                                   { HitBuffer().push_back(1, 2, 3); });
+
+    StreamHeader header(12, 1, 1, 5, 6);
+
+    std::vector<word_t> stream = Event(config, header, frames).serialize_event();
+
+    assert(Event(config, header, buffer).serialize_event() == stream);
+
+    // appends a frame per trigger behind the frames already in the buffer
+    HitBuffer decoded(std::vector<HitCoord>{{1, 1, 1}});
+
+    assert(Decoder(config, stream).decode_hits(decoded) == buffer.size());
+    assert(decoded.n_frames() == 1 + frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        auto frame = decoded.get_frame(i + 1);
+
+        std::sort(frame.begin(), frame.end());
+        std::sort(frames[i].begin(), frames[i].end());
+
+        assert(frame == frames[i]);
+    }
+
+    assert(Event(config, header, frames).get_hit_buffer() == HitBuffer(frames));
+
+    // a module frame routed from the arrays gives the same chips as from the tuples
+    TEPXEvent module(config, header, HitBuffer(std::vector<HitCoord>{{300, 20, 1}, {5, 1000, 2}, {400, 1300, 3}}));
+
+    assert(module.serialize_event(1) == TEPXEvent(config, header, std::vector<HitCoord>{{300, 20, 1}, {5, 1000, 2}, {400, 1300, 3}}).serialize_event(1));
+}
+
+/**
+ * @brief Decodes a stream with several triggers into flat storage and compares with the nested events
+ */
+void test_event_batch()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    // the second trigger has no hits
+    std::vector<std::vector<HitCoord>> frames(3);
+
+    frames[0] = make_hits(config, 300, 0);
+    frames[2] = make_hits(config, 300, 3);
+
+    StreamHeader header(12, 1, 1, 5, 6);
+
+    std::vector<word_t> stream = Event(config, header, frames).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    const EventBatch &batch = decoder.get_batch();
+    Event event = decoder.get_event();
+
+    assert(batch.n_triggers() == frames.size());
+    assert(batch.qcore_offsets().size() == frames.size() + 1 && batch.qcore_offsets().back() == batch.qcores().size());
+
+    std::vector<std::vector<QuarterCore>> nested = event.get_qcores();
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        EventBatch::QcoreView qcores = batch.get_qcores(i);
+
+        assert(std::vector<QuarterCore>(qcores.begin(), qcores.end()) == nested[i]);
+    }
+
+    assert(batch.headers()[0].trigger_tag == 12 && batch.headers()[0].trigger_pos == 1 && batch.headers()[1].trigger_pos == 2);
+
+    HitBuffer hits = batch.get_hits();
+
+    assert(hits.n_frames() == frames.size() && hits.frame_size(1) == 0);
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        auto frame = hits.get_frame(i);
+
+        std::sort(frame.begin(), frame.end());
+        std::sort(frames[i].begin(), frames[i].end());
+
+        assert(frame == frames[i]);
+    }
+
+    // the batch rebuilds the same nested event
+    assert(Event(batch).get_qcores() == nested);
+}
+
+/**
+ * @brief Moves events and decoded triggers around and reads them through the views
+ */
+void test_event_moves()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    // the second trigger has no hits
+    std::vector<std::vector<HitCoord>> frames = {{{10, 20, 3}, {11, 20, 4}, {100, 300, 5}}, {}, {{5, 5, 1}}};
+
+    std::vector<word_t> stream = Event(config, StreamHeader(7, 0), frames).serialize_event();
+
+    Decoder decoder(config, stream);
+    decoder.process_stream();
+
+    Event event = decoder.get_event();
+    std::vector<std::vector<HitCoord>> hits = event.get_hits();
+
+    assert(hits.size() == frames.size() && hits[1].empty() && event.sub_events().size() == frames.size() - 1);
+
+    // the views expose the stored vectors, a move hands them over without copying
+    const QuarterCore *stored = event.qcores_view().data();
+    const HitCoord *stored_hits = event.hits_view().data();
+
+    Event moved(std::move(event));
+    assert(moved.qcores_view().data() == stored && moved.hits_view().data() == stored_hits);
+
+    Event assigned;
+    assigned = std::move(moved);
+    assert(assigned.qcores_view().data() == stored && assigned.get_hits() == hits);
+
+    // the views build the missing representation on first use
+    Event from_hits(config, StreamHeader(7, 0), frames[0]);
+    assert(from_hits.qcores_view() == assigned.qcores_view());
+
+    Event taken = decoder.take_event();
+    assert(taken.get_hits() == hits && decoder.get_batch().n_triggers() == 0);
+
+    decoder.process_stream();
+    const QuarterCore *batch_qcores = decoder.get_batch().qcores().data();
+
+    EventBatch batch = decoder.take_batch();
+    assert(batch.n_triggers() == frames.size() && batch.qcores().data() == batch_qcores);
+    assert(decoder.get_batch().n_triggers() == 0 && Event(batch).get_hits() == hits);
+}
+
+/**
+ * @brief Fills per-pixel histograms from decoded streams on two threads and checks them against the encoded hits
+ */
+void test_pixel_histogram()
+{
+    StreamConfig config(2, 8, true, false, true, false, true, true);
+
+    std::vector<std::vector<word_t>> streams;
+    std::vector<uint32_t> expected_hits(432 * 336, 0), expected_tots(432 * 336 * 16, 0);
+
+    for (int i = 0; i < 6; i++)
+    {
+        std::map<std::pair<uint16_t, uint16_t>, uint8_t> frame;
+
+        for (auto [x, y, tot] : make_hits(config, 400, i))
+            frame[{x, y}] = tot;
+
+        std::vector<HitCoord> hits;
+
+        for (auto &[pixel, tot] : frame)
+        {
+            hits.push_back(HitCoord(pixel.first, pixel.second, tot));
+            expected_hits[pixel.first * 336 + pixel.second]++;
+            expected_tots[(pixel.first * 336 + pixel.second) * 16 + tot]++;
+        }
+
+        streams.push_back(Event(config, StreamHeader(i, 0), hits).serialize_event());
+    }
+
+    // every thread fills its own histogram from half of the streams
+    std::vector<PixelHistogram> histograms(2, PixelHistogram(config));
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < histograms.size(); t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            for (size_t i = t; i < streams.size(); i += histograms.size())
+            {
+                Decoder decoder(config, streams[i]);
+                decoder.process_stream();
+                histograms[t].fill(decoder.get_batch());
+            } });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    PixelHistogram histogram(config);
+
+    for (auto &partial : histograms)
+        histogram.merge(partial);
+
+    assert(histogram.width() == 432 && histogram.height() == 336);
+    assert(histogram.n_hits() == 6 * 400);
+    assert(histogram.hit_counts() == expected_hits && histogram.tot_counts() == expected_tots);
+
+    expect_throw<std::invalid_argument>([&]()
+                                        { histogram.merge(PixelHistogram(StreamConfig(4, 4, true, false, true, false, true, true))); });
+
+    histogram.clear();
+    assert(histogram.n_hits() == 0 && histogram.hit_counts() == std::vector<uint32_t>(432 * 336, 0));
+}
+
+/**
+ * @brief Clusters decoded triggers of both quarter core sizes and compares them with a flood fill over the hits
+ */
+void test_clusterer()
+{
+    for (auto [width, height] : {std::pair<uint8_t, uint8_t>{4, 4}, {8, 2}})
+    {
+        StreamConfig config(height, width, true, false, true, false, true, true);
+
+        // dense blobs crossing quarter core boundaries in every direction, plus scattered single hits
+        std::vector<std::vector<HitCoord>> frames(3);
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            std::map<std::pair<uint16_t, uint16_t>, uint8_t> frame;
+
+            std::vector<HitCoord> scattered = make_hits(config, 3000, i);
+
+            for (int j = 0; j < 3000; j++)
+            {
+                uint16_t col = std::get<0>(scattered[j]), row = std::get<1>(scattered[j]);
+
+                // a filled square and a diagonal line
+                if (j % 3 == 0)
+                    col = 100 + (j / 3) % 12, row = 200 + (j / 36) % 12;
+                else if (j % 3 == 1 && j < 100)
+                    col = 21 + j / 3, row = 31 + j / 3;
+
+                frame[{col, row}] = (j + i) % 15 + 1;
+            }
+
+            for (auto &[pixel, tot] : frame)
+                frames[i].push_back(HitCoord(pixel.first, pixel.second, tot));
+        }
+
+        std::vector<word_t> stream = Event(config, StreamHeader(1, 0), frames).serialize_event();
+
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+
+        Clusterer clusterer(config);
+        std::vector<Cluster> clusters;
+
+        assert(clusterer.cluster(decoder.get_batch(), clusters) == clusters.size());
+
+        std::vector<Cluster> expected;
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            std::map<std::pair<int, int>, uint8_t> remaining;
+
+            for (auto &[col, row, tot] : frames[i])
+                remaining[{col, row}] = tot;
+
+            while (!remaining.empty())
+            {
+                auto [col, row] = remaining.begin()->first;
+                Cluster cluster = {uint16_t(col), uint16_t(col), uint16_t(row), uint16_t(row), 0, 0, uint16_t(i)};
+                std::vector<std::pair<int, int>> todo = {{col, row}};
+
+                cluster.tot = remaining.begin()->second;
+                remaining.erase(remaining.begin());
+
+                while (!todo.empty())
+                {
+                    auto [x, y] = todo.back();
+                    todo.pop_back();
+
+                    cluster.size++;
+                    cluster.col_min = std::min<int>(cluster.col_min, x), cluster.col_max = std::max<int>(cluster.col_max, x);
+                    cluster.row_min = std::min<int>(cluster.row_min, y), cluster.row_max = std::max<int>(cluster.row_max, y);
+
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        for (int dy = -1; dy <= 1; dy++)
+                        {
+                            auto found = remaining.find({x + dx, y + dy});
+
+                            if (found == remaining.end())
+                                continue;
+
+                            cluster.tot += found->second;
+                            todo.push_back(found->first);
+                            remaining.erase(found);
+                        }
+                    }
+                }
+
+                expected.push_back(cluster);
+            }
+        }
+
+        auto order = [](const Cluster &a, const Cluster &b)
+        { return std::make_tuple(a.event, a.col_min, a.row_min, a.size) < std::make_tuple(b.event, b.col_min, b.row_min, b.size); };
+
+        std::sort(clusters.begin(), clusters.end(), order);
+        std::sort(expected.begin(), expected.end(), order);
+
+        assert(clusters == expected);
+        assert(std::any_of(clusters.begin(), clusters.end(), [](const Cluster &cluster)
+                           { return cluster.size >= 144; }));
+    }
+}
+
+/**
+ * @brief Loads decoded triggers into chip bitmaps, combines them and encodes them again
+ */
+void test_chip_bitmap()
+{
+    for (auto [width, height] : {std::pair<uint8_t, uint8_t>{4, 4}, {8, 2}})
+    {
+        StreamConfig config(height, width, true, false, true, false, true, true);
+
+        const uint16_t n_cols = N_QCORES_HORIZONTAL * width, n_rows = N_QCORES_VERTICAL * height;
+
+        std::vector<std::set<std::pair<uint16_t, uint16_t>>> pixels(2);
+        std::vector<std::vector<HitCoord>> frames(2);
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            for (auto [col, row, tot] : make_hits(config, 5000, i))
+                pixels[i].insert({col, row});
+
+            // the corners of the chip
+            pixels[i].insert({0, 0});
+            pixels[i].insert({n_cols - 1, n_rows - 1});
+
+            for (auto [col, row] : pixels[i])
+                frames[i].push_back(HitCoord(col, row, 5));
+        }
+
+        std::vector<word_t> stream = Event(config, StreamHeader(1, 0), frames).serialize_event();
+
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+
+        ChipBitmap first(config, decoder.get_batch().get_qcores(0));
+        ChipBitmap second(config, decoder.get_batch().get_qcores(1));
+
+        assert(first.width() == n_cols && first.height() == n_rows);
+        assert(first.count() == pixels[0].size() && second.count() == pixels[1].size());
+
+        for (auto [col, row] : pixels[0])
+            assert(first.test(col, row));
+
+        std::vector<std::pair<uint16_t, uint16_t>> both;
+        std::set_intersection(pixels[0].begin(), pixels[0].end(), pixels[1].begin(), pixels[1].end(), std::back_inserter(both));
+
+        assert((first & second).count() == both.size());
+        assert((first | second).count() == pixels[0].size() + pixels[1].size() - both.size());
+        assert((first ^ second).count() == pixels[0].size() + pixels[1].size() - 2 * both.size());
+        assert((first & ~second).count() == pixels[0].size() - both.size());
+        assert((first ^ first).none() && (~first).count() == ChipBitmap::N_PIXELS - pixels[0].size());
+
+        // the exported quarter cores encode the same pixels as the event
+        Event event(config, StreamHeader(1, 0), first.to_qcores());
+        std::vector<word_t> encoded = event.serialize_event();
+
+        Decoder redecoder(config, encoded);
+        redecoder.process_stream();
+
+        assert(ChipBitmap(config, redecoder.get_batch().get_qcores(0)) == first);
+
+        std::vector<HitCoord> hits = event.get_hits()[0];
+        assert(hits.size() == pixels[0].size());
+
+        ChipBitmap single(config);
+
+        for (auto [col, row, tot] : hits)
+            single.set(col, row);
+
+        assert(single == first);
+
+        single.clear();
+        assert(single.none() && single.to_qcores().empty());
+    }
+}
+
+/**
+ * @brief Decodes streams repeatedly through an arena and checks that the steady state does not touch the heap
+ */
+void test_arena()
+{
+    Arena arena(256);
+
+    // alignment, growth into new blocks and reuse of the blocks after a reset
+    void *first = arena.allocate(10, 1);
+    assert(reinterpret_cast<uintptr_t>(arena.allocate(8, 64)) % 64 == 0);
+    assert(arena.allocate(1000, 8) != nullptr);
+    assert(arena.n_allocations() == 3 && arena.n_upstream_allocations() == 2 && arena.bytes_used() >= 1018);
+
+    arena.reset();
+    assert(arena.bytes_used() == 0 && arena.allocate(10, 1) == first && arena.n_upstream_allocations() == 2);
+
+    arena.release();
+    assert(arena.capacity() == 0);
+
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    std::vector<std::vector<HitCoord>> frames(4);
+
+    std::vector<HitCoord> scattered = make_hits(config, 500);
+
+    for (size_t j = 0; j < scattered.size(); j++)
+        frames[j % 4].push_back(scattered[j]);
+
+    std::vector<word_t> stream = Event(config, StreamHeader(3, 0), frames).serialize_event();
+
+    HitBuffer hits;
+
+    for (int round = 0; round < 3; round++)
+    {
+        size_t n_before = n_heap_allocations, n_blocks = arena.n_upstream_allocations();
+
+        {
+            Decoder decoder(config, stream, &arena);
+            decoder.process_stream();
+
+            assert(decoder.get_batch().n_triggers() == frames.size());
+            assert(decoder.get_batch().qcores().get_allocator().resource() == &arena);
+        }
+
+        hits.clear();
+        Decoder(config, stream, &arena).decode_hits(hits);
+        assert(hits.n_frames() == frames.size());
+
+        // the first round sizes the arena and the hit buffer, from then on everything is reused
+        if (round > 0)
+            assert(n_heap_allocations == n_before && arena.n_upstream_allocations() == n_blocks);
+
+        arena.reset();
+    }
+}
+
+/**
+ * @brief Scans a capture file of several streams and a cut off one, and decodes the streams in place
+ */
+void test_capture_file()
+{
+    StreamConfig config(4, 4, true, false, false, false, true, false);
+
+    std::string path = (std::filesystem::temp_directory_path() / "rd53event_test_capture.bin").string();
+
+    std::vector<std::vector<word_t>> streams;
+    std::vector<word_t> words;
+
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        streams.push_back(Event(config, StreamHeader(i, 0, i % 4, i), make_hits(config, 30 * i + 1, i)).serialize_event());
+        words.insert(words.end(), streams.back().begin(), streams.back().end());
+    }
+
+    // the start of a stream that was cut off by the end of the capture
+    words.insert(words.end(), streams[2].begin(), streams[2].begin() + 3);
+
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(word_t));
+
+    CaptureFile capture(path);
+
+    assert(capture.n_words() == words.size() && capture.n_trailing_words() == 3);
+
+    StreamView stream;
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        assert(capture.next(stream));
+        assert(std::equal(stream.begin(), stream.end(), streams[i].begin(), streams[i].end()));
+        assert(stream.begin() >= capture.words().begin() && stream.end() <= capture.words().end());
+
+        Decoder decoder(config, stream);
+        decoder.process_stream();
+
+        Decoder expected(config, streams[i]);
+        expected.process_stream();
+
+        assert(decoder.get_event().header.bcid == i && decoder.get_event().get_hits() == expected.get_event().get_hits());
+    }
+
+    assert(!capture.next(stream) && capture.position() == words.size() - 3);
+
+    capture.rewind();
+    assert(capture.next(stream) && stream.size == streams[0].size());
+
+    CaptureFile moved(std::move(capture));
+    assert(moved.streams().size() == streams.size() && moved.position() == streams[0].size());
+    assert(capture.n_words() == 0 && !capture.next(stream));
+
+    // a size that is not a whole number of words
+    std::ofstream(path, std::ios::binary).write("twelve bytes", 12);
+
+    expect_throw<std::runtime_error>([&]()
+                                     { CaptureFile odd(path); });
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc).close();
+    assert(CaptureFile(path).streams().empty());
+
+    std::filesystem::remove(path);
+
+    expect_throw<std::runtime_error>([&]()
+                                     { CaptureFile missing(path); });
+}
+
+/**
+ * @brief Builds, saves and reloads the sidecar index of a capture and reads single streams through it
+ */
+void test_capture_index()
+{
+    StreamConfig config(4, 4, true, false, true, false, true, true);
+
+    std::string path = (std::filesystem::temp_directory_path() / "rd53event_test_index.bin").string();
+    std::string sidecar = CaptureIndex::sidecar_path(path);
+
+    std::vector<std::vector<word_t>> streams;
+    std::vector<word_t> words;
+
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        std::vector<std::vector<HitCoord>> frames = {make_hits(config, 20 * i + 1, i), {HitCoord(i, i, 1)}};
+
+        streams.push_back(Event(config, StreamHeader(i * 7 % 64, i % 4, i % 4, 10 + i, 20 + i), frames).serialize_event());
+        words.insert(words.end(), streams.back().begin(), streams.back().end());
+    }
+
+    words.push_back(0);
+
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(word_t));
+    std::filesystem::remove(sidecar);
+
+    CaptureFile capture(path);
+    CaptureIndex index(capture, config);
+
+    assert(index.size() == streams.size() && index.matches(capture, config));
+
+    for (size_t i = 0; i < streams.size(); i++)
+    {
+        Decoder decoder(config, streams[i]);
+        decoder.process_stream();
+
+        // the index reads the header the way the decoder does
+        const StreamHeader &header = decoder.get_event().header;
+        const StreamIndexEntry &entry = index.at(i);
+
+        assert(entry.trigger_tag == header.trigger_tag && entry.trigger_pos == header.trigger_pos && entry.chip_id == header.chip_id);
+        assert(entry.bcid == header.bcid && entry.l1id == header.l1id && entry.n_words == streams[i].size());
+
+        StreamView stream = index.stream(capture, i);
+        assert(std::equal(stream.begin(), stream.end(), streams[i].begin(), streams[i].end()));
+
+        capture.seek(entry.offset);
+        assert(capture.next(stream) && stream.data == index.stream(capture, i).data);
+    }
+
+    assert(index.find_trigger_tag(3 * 7) == 3 && index.find_trigger_tag(0, 1) == index.size());
+    assert(index.streams(capture, 7, 100).size() == 3 && index.streams(capture, 7, 100)[0].data == index.stream(capture, 7).data);
+    assert(!index.matches(capture, StreamConfig(4, 4, true, false, true, false, true, false)));
+
+    // the sidecar is built once, then loaded
+    assert(!std::filesystem::exists(sidecar));
+    assert(CaptureIndex::open(capture, config).entries() == index.entries());
+    assert(std::filesystem::file_size(sidecar) < words.size() * sizeof(word_t));
+
+    CaptureIndex loaded = CaptureIndex::load(sidecar);
+    assert(loaded.entries() == index.entries() && loaded.matches(capture, config));
+
+    // a damaged sidecar is rebuilt by open and rejected by load
+    std::filesystem::resize_file(sidecar, std::filesystem::file_size(sidecar) - 5);
+
+    expect_throw<std::runtime_error>([&]()
+                                     { CaptureIndex::load(sidecar); });
+    assert(CaptureIndex::open(capture, config).entries() == index.entries());
+    assert(CaptureIndex::load(sidecar).entries() == index.entries());
+
+    // the capture is overwritten in place by a run of the same size, with the streams at other offsets
+    std::vector<word_t> reordered;
+
+    for (size_t i = streams.size(); i-- > 0;)
+        reordered.insert(reordered.end(), streams[i].begin(), streams[i].end());
+
+    reordered.push_back(0);
+    assert(reordered.size() == words.size());
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char *>(reordered.data()), reordered.size() * sizeof(word_t));
+
+    CaptureFile rewritten(path);
+
+    // the check of the stream boundaries catches it even if the modification time did not change
+    assert(!index.matches(rewritten, config) && !CaptureIndex::load(sidecar).matches(rewritten, config));
+
+    expect_throw<std::invalid_argument>([&]()
+                                        { index.stream(rewritten, 0); });
+
+    CaptureIndex rebuilt = CaptureIndex::open(rewritten, config);
+    assert(rebuilt.size() == streams.size() && rebuilt.at(0).n_words == streams.back().size());
+    assert(CaptureIndex::load(sidecar).matches(rewritten, config));
+
+    // a capture that was touched since is out of date as well
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(1));
+    assert(!rebuilt.matches(CaptureFile(path), config));
+
+    std::filesystem::remove(sidecar);
+    std::filesystem::remove(path);
+}
+
+/**
+ * @brief Compares the ToT expansion and packing kernels with a bit by bit reference
+ */
+void test_tot_expansion()
+{
+    for (uint32_t hits = 0; hits <= 0xFFFF; hits += 7)
+    {
+        uint8_t n_bits = 4 * __builtin_popcount(hits);
+        uint64_t packed = n_bits == 0 ? 0 : (0x9E3779B97F4A7C15ull * hits) >> (64 - n_bits);
+
+        uint64_t expected = 0, remaining = packed;
+
+        for (int8_t i = 0; i < 16; i++)
+        {
+            if (hits >> i & 1)
+            {
+                expected |= (remaining & 0xF) << (i * 4);
+                remaining >>= 4;
+            }
+        }
+
+        assert(tots::expand_portable(hits, packed) == expected);
+        assert(tots::expand(hits, packed) == expected);
+
+        if (tots::has_bmi2)
+            assert(tots::expand_bmi2(hits, packed) == expected);
+
+        assert(tots::compress_portable(hits, expected) == packed);
+        assert(tots::compress(hits, expected) == packed);
+    }
+}
+
 int main()
 {
+    test_bit_reader();
+    test_qcore_layout();
+    test_binary_tree();
+    test_tot_expansion();
+    test_stream_decoder();
+    test_parallel_decoder();
+    test_decode_hits();
+    test_decode_occupancy();
+    test_sub_events();
+    test_qcores_from_hits();
+    test_tepx_event();
+    test_hit_buffer();
+    test_event_batch();
+    test_event_moves();
+    test_pixel_histogram();
+    test_clusterer();
+    test_chip_bitmap();
+    test_arena();
+    test_capture_file();
+    test_capture_index();
+
     StreamConfig config;
 
     config.chip_id = true;